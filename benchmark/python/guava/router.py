@@ -0,0 +1,35 @@
+#!/usr/bin/env python
+
+# Times the mount point lookup of Server.route with 1k and 10k mounted routers.
+
+import sys
+import time
+
+import guava
+
+
+def bench(count, rounds):
+    server = guava.server.Server()
+    server.add_router(guava.router.MVCRouter('/'))
+    for i in range(count):
+        server.add_router(guava.router.MVCRouter('/app%d/' % i, package='app%d' % i))
+
+    requests = [guava.request.Request(method='GET', url='/app%d/index/show' % (i * 7 % count))
+                for i in range(1000)]
+
+    server.route(requests[0])
+
+    start = time.time()
+    for _ in range(rounds):
+        for req in requests:
+            server.route(req)
+    elapsed = time.time() - start
+
+    total = rounds * len(requests)
+    print('%6d mount points: %8.2f us/route (%d routes)' % (count, elapsed * 1000000 / total, total))
+
+
+if __name__ == '__main__':
+    rounds = int(sys.argv[1]) if len(sys.argv) > 1 else 100
+    for count in (1000, 10000):
+        bench(count, rounds)
@@ -43,9 +43,49 @@ typedef uint8_t guava_bool_t;
 #define GUAVA_SERVER_DEFAULT_LISTEN_IP "0.0.0.0"
 #define GUAVA_SERVER_DEFAULT_LISTEN_PORT 8000
 #define GUAVA_SERVER_DEFAULT_LISTEN_BACKLOG 128
+#define GUAVA_SERVER_DEFAULT_WORKERS 1
+
+#define GUAVA_SERVER_READ_BUFFER_SIZE 65536
+#define GUAVA_SERVER_READ_BUFFER_POOL_SIZE 64
+#define GUAVA_SERVER_IDLE_READ_BUFFER_SIZE 4096
+#define GUAVA_SERVER_IDLE_READ_BUFFER_POOL_SIZE 1024
+#define GUAVA_SERVER_HEADER_BUFFER_SIZE 4096
+#define GUAVA_SERVER_HEADER_BUFFER_POOL_SIZE 256
+#define GUAVA_SERVER_DEFAULT_UPLOAD_SPILL_SIZE (1024 * 1024)
+#define GUAVA_SERVER_DEFAULT_CONN_HIGH_WATER 1024
+#define GUAVA_SERVER_DEFAULT_RESPONSE_HIGH_WATER 1024
+#define GUAVA_ROUTER_CACHE_SIZE 512
+#define GUAVA_FILE_CACHE_SIZE 1024 /* open static files kept per server, each holds an fd */
+#define GUAVA_FILE_CACHE_VALID 60 /* seconds a cached file is trusted, watches miss what happens above its directory */
+#define GUAVA_FILE_CACHE_MEMORY_BUDGET (16 * 1024 * 1024) /* bytes of small static files kept in memory */
+#define GUAVA_ROUTER_STATIC_MEMORY_FILE_SIZE (16 * 1024) /* static files up to this size are served from memory */
+#define GUAVA_HANDLER_STATIC_MAX_RANGES 16 /* requests asking for more ranges get the whole file */
+#define GUAVA_ROUTER_STATIC_GZIP_MAX_SIZE (1024 * 1024) /* bigger files are not compressed on the fly */
+#define GUAVA_FILE_VARIANT_SEP '\x01' /* separates a path from the encodings in the cache key of a variant */
+
+/* All the timeouts are in seconds, 0 disables the timeout */
+#define GUAVA_SERVER_DEFAULT_HEADER_TIMEOUT 10
+#define GUAVA_SERVER_DEFAULT_BODY_TIMEOUT 30
+#define GUAVA_SERVER_DEFAULT_KEEPALIVE_TIMEOUT 15
+#define GUAVA_SERVER_DEFAULT_WRITE_TIMEOUT 30
+
+#define GUAVA_TIMER_WHEEL_SLOTS 512
+#define GUAVA_TIMER_WHEEL_TICK 1000 /* in milliseconds */
+
+#define GUAVA_SERVER_DATE_INTERVAL 1000 /* in milliseconds */
+
+#define GUAVA_CONN_MAX_WRITE_BUFS 64 /* max bufs coalesced into one write */
+
+#define GUAVA_RESPONSE_INLINE_SEGMENTS 4
+#define GUAVA_RESPONSE_INLINE_PARTS 1
+#define GUAVA_RESPONSE_INLINE_HEADERS 8
+#define GUAVA_REQUEST_INLINE_HEADERS 16
+#define GUAVA_CONN_ARENA_CHUNK_SIZE 2048 /* request scoped strings of a connection */
+#define GUAVA_RESPONSE_COPY_THRESHOLD 512 /* smaller writes are copied, bigger ones referenced */
 
 typedef struct {
   size_t len;
+  size_t flags; /* a full word, data must start right at the end of the header */
   char   data[0];
 } guava_string_header_t;
 
@@ -75,12 +115,34 @@ typedef struct {
   guava_session_store_type_t type;
 } guava_session_store_t;
 
+typedef struct guava_router_cache_s guava_router_cache_t;
+
+typedef enum {
+  GUAVA_ROUTER_SEGMENT_STATIC,
+  GUAVA_ROUTER_SEGMENT_INT,
+  GUAVA_ROUTER_SEGMENT_STR
+} guava_router_segment_type_t;
+
+typedef struct guava_router_template_s guava_router_template_t;
+
+/* Segment trie of path templates like /users/{id:int}/posts/{slug} */
+struct guava_router_template_s {
+  guava_router_segment_type_t type;
+  guava_string_t              label;   /* the segment text of static segments */
+  PyObject                   *handler; /* the template ending right here, NULL if none */
+  guava_router_template_t   **children;
+  size_t                      nchildren;
+};
+
 typedef struct {
   guava_router_type_t    type;
   guava_string_t         mount_point;
   guava_string_t         package;
   guava_session_store_t *session_store;
   PyObject              *routes; /* Special routes for overriding the default actions */
+  guava_router_cache_t  *cache;  /* resolved handlers of the MVC and REST routers */
+  guava_router_template_t *templates;       /* compiled from routes, NULL until it is needed */
+  PyObject                *templates_items; /* keys and values of routes the templates were compiled from */
 } guava_router_t;
 
 typedef struct {
@@ -93,15 +155,255 @@ typedef struct {
   PyObject       *args;
 } guava_handler_t;
 
+typedef struct guava_router_cache_entry_s guava_router_cache_entry_t;
+
+struct guava_router_cache_entry_s {
+  guava_router_cache_entry_t *hnext; /* hash chain */
+  guava_router_cache_entry_t *prev;  /* LRU list, most recently used first */
+  guava_router_cache_entry_t *next;
+  uint32_t                    hash;
+  int                         method;
+  guava_string_t              key;
+  guava_handler_t             handler; /* template without args and router */
+};
+
+struct guava_router_cache_s {
+  guava_router_cache_entry_t **buckets;
+  size_t                       nbuckets;
+  size_t                       count;
+  size_t                       capacity;
+  guava_router_cache_entry_t  *head;
+  guava_router_cache_entry_t  *tail;
+  uint64_t                     hits;
+  uint64_t                     misses;
+};
+
+typedef struct {
+  size_t    size;       /* size of every object handed out by this slab */
+  size_t    high_water; /* max number of free objects kept for reusing */
+  size_t    nfree;
+  void     *free_list;
+  uint64_t  hits;       /* allocations served from the free list */
+  uint64_t  misses;     /* allocations which fell back to the system allocator */
+} guava_slab_t;
+
+#define GUAVA_STRBUF_BORROWED 0x01 /* data is the caller's memory, never freed here */
+
+/*
+ * Growable string, the owned storage carries a guava_string_header_t in front
+ * of data so it turns into a guava_string_t without copying
+ */
+typedef struct {
+  char    *data;
+  size_t   len;
+  size_t   size;  /* capacity, not counting the terminating NUL */
+  uint8_t  flags;
+} guava_strbuf_t;
+
+#define GUAVA_MEM_MAX_SITES 4096 /* call sites tracked by the debug allocator */
+
+/* Allocations done from one file:line, only filled under GUAVA_MEM_DEBUG */
+typedef struct {
+  const char *file;
+  int         line;
+  uint64_t    allocs;
+  uint64_t    frees;
+  size_t      live_objects;
+  size_t      live_bytes;
+} guava_mem_site_t;
+
+typedef struct {
+  uint64_t allocs;
+  uint64_t frees;
+  size_t   live_objects;
+  size_t   live_bytes;
+  size_t   peak_bytes;
+  size_t   nsites;
+} guava_mem_stats_t;
+
+typedef struct guava_arena_chunk_s guava_arena_chunk_t;
+
+struct guava_arena_chunk_s {
+  guava_arena_chunk_t *next;
+  size_t               size;
+  size_t               used;
+  char                 data[0];
+};
+
+/* Bump allocator, everything handed out is released at once by a reset */
+typedef struct {
+  guava_arena_chunk_t *chunks;     /* the current chunk first, the one kept over resets last */
+  char                *last;       /* the latest allocation, the only one which may grow in place */
+  size_t               last_size;
+  size_t               allocated;  /* bytes handed out since the last reset */
+  size_t               high_water; /* max bytes handed out between two resets */
+} guava_arena_t;
+
+typedef struct guava_timer_s guava_timer_t;
+
+typedef void (*guava_timer_cb)(guava_timer_t *timer);
+
+struct guava_timer_s {
+  guava_timer_t  *next;
+  guava_timer_t  *prev;
+  int             slot;   /* -1 while the timer is not scheduled */
+  uint32_t        rounds; /* full turns of the wheel left before firing */
+  guava_timer_cb  cb;
+};
+
+typedef struct {
+  uv_timer_t      timer;
+  size_t          current;
+  size_t          count;
+  guava_timer_t  *slots[GUAVA_TIMER_WHEEL_SLOTS];
+} guava_timer_wheel_t;
+
+typedef struct guava_file_s guava_file_t;
+
+typedef struct guava_file_watch_s guava_file_watch_t;
+
+typedef struct guava_file_cache_s guava_file_cache_t;
+
+/* An open static file, shared by the cache and the responses sending it */
+struct guava_file_s {
+  guava_file_t       *hnext;      /* hash chain */
+  guava_file_t       *prev;       /* LRU list, most recently used first */
+  guava_file_t       *next;
+  guava_file_t       *mprev;      /* LRU list of the files kept in memory */
+  guava_file_t       *mnext;
+  guava_file_cache_t *cache;
+  guava_file_watch_t *watch;      /* watch of its directory, NULL once out of the cache */
+  uint32_t            hash;
+  guava_string_t      path;
+  uv_file             fd;         /* -1 once the contents are in data */
+  char               *data;       /* whole contents of a small file, NULL if it is sent with sendfile */
+  guava_string_t      headers;    /* pre-serialized entity header lines of a 200 */
+  size_t              size;
+  uint64_t            ino;
+  uv_timespec_t       mtime;
+  const char         *mime_type;
+  const char         *encoding;   /* Content-Encoding of the contents, NULL for identity */
+  char                etag[64];
+  char                last_modified[32]; /* mtime as an HTTP-date */
+  size_t              refcnt;     /* one for the cache, one per response sending it */
+  uint64_t            expires;    /* loop time in ms, the file is opened again after it */
+};
+
+/* Directory watched for changes, as long as one of its files is cached */
+struct guava_file_watch_s {
+  uv_fs_event_t       handle;
+  guava_file_cache_t *cache;
+  guava_string_t      dir;
+  size_t              nfiles;
+  guava_file_watch_t *next;
+};
+
+struct guava_file_cache_s {
+  uv_loop_t          *loop;
+  guava_file_t      **buckets;
+  size_t              nbuckets;
+  size_t              count;
+  size_t              capacity;
+  guava_file_t       *head;
+  guava_file_t       *tail;
+  guava_file_t       *mhead;         /* the files with data, evicted first when over the budget */
+  guava_file_t       *mtail;
+  guava_file_watch_t *watches;
+  size_t              memory_used;   /* bytes of the cached files kept in memory */
+  size_t              memory_budget;
+  size_t              memory_count;
+  uint64_t            hits;
+  uint64_t            misses;
+  uint64_t            invalidations;
+  uint64_t            evictions;
+};
+
+typedef struct guava_router_node_s guava_router_node_t;
+
+/* Radix tree of the mount points, every edge is labelled with a string */
+struct guava_router_node_s {
+  guava_string_t        label;
+  PyObject             *router; /* the router mounted right here, NULL if none */
+  guava_router_node_t **children;
+  size_t                nchildren;
+};
+
 typedef struct {
   uv_loop_t     loop;
   uv_tcp_t      server;
   uv_signal_t   signal;
   PyObject     *routers;
+  guava_router_node_t *router_tree; /* compiled from routers, NULL until it is needed */
+  Py_ssize_t    router_tree_size;   /* number of routers the tree was compiled from */
+  unsigned long router_tree_generation; /* mount point changes the tree was compiled after */
   PyObject     *middlewares;
   guava_bool_t  debug;
+  int           workers;   /* number of prefork worker processes, 1 means no fork */
+  guava_slab_t  read_buffers;
+  guava_slab_t  idle_read_buffers; /* smaller buffers for connections waiting for a new request */
+  guava_slab_t  header_buffers;    /* serialized response headers */
+  guava_slab_t  conns;
+  guava_slab_t  responses;
+  int           conn_high_water;     /* max number of freed conns kept for reusing */
+  int           response_high_water; /* max number of freed responses kept for reusing */
+  guava_timer_wheel_t timers;
+  uv_timer_t    date_timer;
+  char          date[64]; /* the whole "Date: ...\r\n" header line */
+  size_t        date_len;
+  int           header_timeout;    /* from the first byte of a request to the end of its headers */
+  int           body_timeout;      /* max idle time between two chunks of the body */
+  int           keepalive_timeout; /* max idle time of a keep-alive connection between requests */
+  int           write_timeout;     /* max time for writing one response */
+  size_t        max_body_size;     /* bigger request bodies are refused with 413, 0 means no limit */
+  size_t        upload_spill_size; /* uploaded files bigger than this are written to temp files */
+  size_t        arena_high_water;  /* max bytes one request took from its conn arena */
+  guava_file_cache_t files;        /* open static files */
+  size_t        static_memory_budget; /* bytes of small static files the file cache keeps in memory */
 } guava_server_t;
 
+typedef struct {
+  uint8_t         state;
+  uint8_t         escape; /* number of characters seen of a %XX escape */
+  char            hex;    /* the first hex digit of the escape */
+  guava_strbuf_t  name;   /* kept between pairs, only cleared */
+  guava_strbuf_t  value;
+} guava_form_parser_t;
+
+typedef struct {
+  uint8_t         state;
+  uint8_t         failed;         /* an upload could not be stored, the request fails */
+  guava_string_t  boundary;       /* CRLF--boundary */
+  size_t          matched;        /* bytes of the boundary matched so far, may span chunks */
+  uint8_t         header_matched; /* bytes of the CRLFCRLF ending the part headers */
+  guava_strbuf_t  header;
+  guava_string_t  name;
+  guava_string_t  filename;
+  guava_string_t  content_type;
+  guava_strbuf_t  data;           /* body of the current part while it is kept in memory */
+  size_t          size;
+  int             fd;             /* temp file of the current part, -1 if in memory */
+  guava_string_t  path;
+  size_t          spill_size;     /* file parts bigger than this are written to a temp file */
+  PyObject       *tmp_files;      /* paths of the temp files, removed with the request */
+} guava_multipart_parser_t;
+
+typedef enum {
+  GUAVA_REQUEST_BODY_RAW = 0,
+  GUAVA_REQUEST_BODY_URLENCODED,
+  GUAVA_REQUEST_BODY_MULTIPART
+} guava_request_body_type_t;
+
+typedef struct {
+  const char *base;   /* into the read buffer, NULL once the bytes are copied into header_data */
+  size_t      offset; /* into header_data if base is NULL */
+  size_t      len;
+} guava_slice_t;
+
+typedef struct {
+  guava_slice_t name;
+  guava_slice_t value;
+} guava_request_header_t;
+
 typedef struct {
   uint16_t        major;
   uint16_t        minor;
@@ -111,34 +413,136 @@ typedef struct {
   guava_string_t  body;
   guava_string_t  path;
   guava_string_t  host;
-  PyObject       *HEADERS;
+  guava_request_header_t *headers;
+  size_t          nheaders;
+  size_t          headers_size;
+  guava_string_t  header_data; /* header bytes which outlived their read buffer */
+  guava_arena_t  *arena;       /* where url, path, host and header_data live, NULL for the heap */
+  guava_request_header_t  inline_headers[GUAVA_REQUEST_INLINE_HEADERS];
+  PyObject       *HEADERS; /* built from the slices on first access */
+  uint8_t         body_type;
+  size_t          body_size;
+  guava_strbuf_t  body_buf; /* the body while it arrives, handed over to body when it is complete */
+  guava_form_parser_t form;
+  guava_multipart_parser_t multipart;
+  PyObject       *FILES; /* uploaded files of a multipart body */
   PyObject       *GET; /* Dict for storing the get parameters */
   PyObject       *POST; /* Dict for storing the post parameters */
   PyObject       *COOKIES;
 } guava_request_t;
 
+typedef enum {
+  GUAVA_HEADER_SERVER = 0,
+  GUAVA_HEADER_DATE,
+  GUAVA_HEADER_CONNECTION,
+  GUAVA_HEADER_CONTENT_TYPE,
+  GUAVA_HEADER_CONTENT_LENGTH,
+  GUAVA_HEADER_CONTENT_ENCODING,
+  GUAVA_HEADER_CONTENT_RANGE,
+  GUAVA_HEADER_ACCEPT_RANGES,
+  GUAVA_HEADER_CACHE_CONTROL,
+  GUAVA_HEADER_ETAG,
+  GUAVA_HEADER_LAST_MODIFIED,
+  GUAVA_HEADER_LOCATION,
+  GUAVA_HEADER_SET_COOKIE,
+  GUAVA_HEADER_VARY,
+  GUAVA_HEADER_KNOWN_MAX
+} guava_header_id_t;
+
+#define GUAVA_HEADER_NAME_OWNED  (1 << 0)
+#define GUAVA_HEADER_VALUE_OWNED (1 << 1)
+
+typedef struct {
+  const char *name;
+  size_t      name_len;
+  const char *value;
+  size_t      value_len;
+  uint8_t     flags;
+} guava_header_t;
+
+typedef struct {
+  guava_header_t *entries;
+  size_t          nentries;
+  size_t          size;
+  uint16_t        known[GUAVA_HEADER_KNOWN_MAX]; /* index + 1 of the well-known headers, 0 if not set */
+  guava_header_t  inline_entries[GUAVA_RESPONSE_INLINE_HEADERS];
+} guava_headers_t;
+
+typedef struct guava_response_s guava_response_t;
+
 typedef struct {
   uv_tcp_t              stream;
   http_parser           parser;
   http_parser_settings  parser_settings;
   uv_write_t            write_req;
+  uv_fs_t               sendfile_req;
+  uv_poll_t             poll;     /* waits for the socket to drain when sendfile would block */
+  int                   poll_fd;  /* dup of the socket fd, a uv_tcp_t and a uv_poll_t can't share one */
   PyObject             *request;
   guava_server_t       *server;
   uint8_t               keep_alive;
-  guava_string_t        auxiliary_current_header;
+  uint8_t               in_read;  /* responses are only queued while parsing, flushed after */
+  uint8_t               closed;   /* handle closed while a sendfile or a parked response is still running */
   uint8_t               auxiliary_last_was_header;
+  uint8_t               in_body;  /* the headers of the request being parsed are complete */
+  uint8_t               poll_open;
+  uint8_t               polling;  /* the sendfile of the sending response waits on the poll */
+  guava_timer_t         timer;
+  guava_response_t     *pending;  /* responses waiting to be written, in request order */
+  guava_response_t     *pending_tail;
+  guava_response_t     *writing;  /* responses of the write in flight */
+  guava_response_t     *sending;  /* response whose file body is being sent */
+  size_t                parked;   /* queued responses still waiting on the filesystem */
+  guava_arena_t         arena;    /* request scoped data, reset after every request */
 } guava_conn_t;
 
 typedef struct {
-  uint16_t        major;
-  uint16_t        minor;
-  uint16_t        status_code;
-  PyObject       *headers;
-  PyObject       *cookies;
-  guava_conn_t   *conn;
-  guava_string_t  data;
-  guava_string_t  serialized_data;
-} guava_response_t;
+  const char     *base;
+  size_t          len;
+  PyObject       *object; /* keeps the referenced Python string or buffer alive */
+  guava_strbuf_t  str;    /* owned copy, str.data is NULL if the data is referenced */
+} guava_response_segment_t;
+
+/* A range of the response's file, sent with sendfile after the segments */
+typedef struct {
+  int64_t offset;
+  size_t  size;
+  size_t  tail_off; /* data written after the range, kept in the response's tails */
+  size_t  tail_len;
+} guava_response_part_t;
+
+struct guava_response_s {
+  uint16_t          major;
+  uint16_t          minor;
+  uint16_t          status_code;
+  uint8_t           keep_alive;
+  uint8_t           parked;      /* queued but not serialized yet, the write stops in front of it */
+  guava_headers_t   headers;
+  PyObject         *cookies;
+  guava_conn_t     *conn;
+  guava_strbuf_t    header;      /* serialized status line and headers */
+  char             *header_mem;  /* pooled buffer the header starts in, NULL if none */
+  guava_slab_t     *header_slab; /* where header_mem comes from */
+  guava_response_segment_t *segments;
+  size_t            nsegments;
+  size_t            segments_size;
+  size_t            body_len;
+  guava_response_segment_t  inline_segments[GUAVA_RESPONSE_INLINE_SEGMENTS];
+  uv_file           file;        /* the parts are sent from it with sendfile, -1 if none */
+  guava_file_t     *cached_file; /* reference on the shared file the fd belongs to, NULL if the fd is owned */
+  const char       *raw_headers; /* pre-serialized lines carrying Content-Type and Content-Length */
+  size_t            raw_headers_len;
+  guava_response_part_t *parts;
+  size_t            nparts;
+  size_t            parts_size;
+  size_t            part;        /* the one being sent */
+  guava_strbuf_t    tails;
+  guava_response_part_t  inline_parts[GUAVA_RESPONSE_INLINE_PARTS];
+  int64_t           file_offset; /* what is left of the part being sent */
+  size_t            file_size;
+  guava_response_t *next;
+  guava_slab_t     *slab; /* where this response comes from, NULL for the system allocator */
+};
 
 typedef struct {
   guava_string_t name;
@@ -0,0 +1,22 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_ARENA_H__
+#define __GUAVA_ARENA_H__
+
+#include "guava.h"
+
+void guava_arena_init(guava_arena_t *arena);
+
+void guava_arena_deinit(guava_arena_t *arena);
+
+void *guava_arena_alloc(guava_arena_t *arena, size_t size);
+
+void *guava_arena_realloc(guava_arena_t *arena, void *p, size_t old_size, size_t size);
+
+void guava_arena_reset(guava_arena_t *arena);
+
+#endif /* !__GUAVA_ARENA_H__ */
@@ -9,8 +9,18 @@
 
 #include "guava.h"
 
-guava_conn_t *guava_conn_new(void);
+guava_conn_t *guava_conn_new(guava_server_t *server);
 
 void guava_conn_free(guava_conn_t *conn);
 
+guava_bool_t guava_conn_release(guava_conn_t *conn);
+
+void guava_conn_close_poll(guava_conn_t *conn);
+
+void guava_conn_set_timeout(guava_conn_t *conn, int timeout);
+
+void guava_conn_queue_response(guava_conn_t *conn, guava_response_t *resp);
+
+void guava_conn_flush(guava_conn_t *conn);
+
 #endif /* !__GUAVA_CONN_H__ */
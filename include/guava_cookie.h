@@ -64,4 +64,6 @@ guava_bool_t guava_cookie_get_httponly(guava_cookie_t *cookie);
 
 PyObject *guava_cookie_parse(char **data);
 
+void guava_cookie_render(guava_cookie_t *cookie, guava_strbuf_t *buf);
+
 #endif /* !__GUAVA_COOKIE_H__ */
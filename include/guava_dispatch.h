@@ -0,0 +1,46 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_DISPATCH_H__
+#define __GUAVA_DISPATCH_H__
+
+#include "guava.h"
+
+typedef struct guava_dispatch_entry_s guava_dispatch_entry_t;
+
+struct guava_dispatch_entry_s {
+  guava_dispatch_entry_t *next;
+  uint32_t                hash;
+  guava_string_t          package;
+  guava_string_t          module;
+  guava_string_t          cls;
+  guava_string_t          action;
+  PyObject               *cls_object;
+  PyObject               *action_name; /* interned */
+};
+
+typedef struct {
+  guava_dispatch_entry_t **buckets;
+  size_t                   nbuckets;
+  size_t                   count;
+  uint64_t                 hits;
+  uint64_t                 misses;
+} guava_dispatch_cache_t;
+
+guava_dispatch_entry_t *guava_dispatch_lookup(guava_handler_t *handler);
+
+void guava_dispatch_invalidate(void);
+
+/* Drops the cache with its buckets, it is rebuilt on the next lookup */
+void guava_dispatch_free(void);
+
+guava_dispatch_cache_t *guava_dispatch_cache(void);
+
+PyObject *guava_dispatch_before_action_name(void);
+
+PyObject *guava_dispatch_after_action_name(void);
+
+#endif /* !__GUAVA_DISPATCH_H__ */
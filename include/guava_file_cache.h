@@ -0,0 +1,38 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_FILE_CACHE_H__
+#define __GUAVA_FILE_CACHE_H__
+
+#include "guava.h"
+
+void guava_file_cache_init(guava_file_cache_t *cache, uv_loop_t *loop, size_t capacity, size_t memory_budget);
+
+void guava_file_cache_close(guava_file_cache_t *cache);
+
+void guava_file_cache_clear(guava_file_cache_t *cache);
+
+guava_file_t *guava_file_cache_get(guava_file_cache_t *cache, const char *path);
+
+guava_file_t *guava_file_cache_put(guava_file_cache_t *cache,
+                                   const char *path,
+                                   uv_file fd,
+                                   const uv_stat_t *st,
+                                   const char *mime_type,
+                                   const char *encoding,
+                                   char *data);
+
+void guava_file_cache_invalidate(guava_file_cache_t *cache, const char *path, size_t len);
+
+void guava_file_close_async(uv_loop_t *loop, uv_file fd);
+
+void guava_file_set_stat(guava_file_t *file, const uv_stat_t *st);
+
+void guava_file_retain(guava_file_t *file);
+
+void guava_file_release(guava_file_t *file);
+
+#endif /* !__GUAVA_FILE_CACHE_H__ */
@@ -0,0 +1,20 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_FORM_H__
+#define __GUAVA_FORM_H__
+
+#include "guava.h"
+
+void guava_form_parser_init(guava_form_parser_t *parser);
+
+void guava_form_parser_deinit(guava_form_parser_t *parser);
+
+void guava_form_parser_execute(guava_form_parser_t *parser, const char *buf, size_t len, PyObject *dict);
+
+void guava_form_parser_finish(guava_form_parser_t *parser, PyObject *dict);
+
+#endif /* !__GUAVA_FORM_H__ */
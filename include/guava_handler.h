@@ -28,9 +28,7 @@ guava_bool_t guava_handler_is_valid(guava_handler_t *handler);
 void guava_handler_static(guava_router_t *router,
                           guava_conn_t *conn,
                           guava_request_t *req,
-                          guava_response_t *resp,
-                          uv_write_cb on_write,
-                          uv_fs_cb on_sendfile);
+                          guava_response_t *resp);
 
 void guava_handler_mark_valid(guava_handler_t *handler);
 
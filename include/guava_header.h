@@ -0,0 +1,32 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_HEADER_H__
+#define __GUAVA_HEADER_H__
+
+#include "guava.h"
+
+void guava_headers_init(guava_headers_t *headers);
+
+void guava_headers_deinit(guava_headers_t *headers);
+
+int guava_header_known_id(const char *name, size_t len);
+
+const char *guava_header_known_name(guava_header_id_t id);
+
+void guava_headers_set(guava_headers_t *headers, const char *name, size_t name_len, const char *value, size_t value_len);
+
+void guava_headers_set_known(guava_headers_t *headers, guava_header_id_t id, const char *value, size_t value_len);
+
+void guava_headers_set_static(guava_headers_t *headers, guava_header_id_t id, const char *value);
+
+const guava_header_t *guava_headers_get(guava_headers_t *headers, const char *name, size_t len);
+
+const guava_header_t *guava_headers_get_known(guava_headers_t *headers, guava_header_id_t id);
+
+PyObject *guava_headers_to_dict(guava_headers_t *headers);
+
+#endif /* !__GUAVA_HEADER_H__ */
@@ -11,18 +11,29 @@
 
 #ifdef GUAVA_MEM_DEBUG
 
-void *guava_malloc(size_t size);
+void *guava_malloc_debug(size_t      size,
+                         const char *file,
+                         int         line);
 
-void *guava_calloc(size_t count,
-                   size_t size);
+void *guava_calloc_debug(size_t      count,
+                         size_t      size,
+                         const char *file,
+                         int         line);
 
-void guava_free(void *p);
+void guava_free_debug(void *p);
 
-void *guava_realloc(void   *p,
-                    size_t  size);
+void *guava_realloc_debug(void       *p,
+                          size_t      size,
+                          const char *file,
+                          int         line);
 
 size_t guava_malloc_size(void *p);
 
+#define guava_malloc(size) guava_malloc_debug((size), __FILE__, __LINE__)
+#define guava_calloc(count, size) guava_calloc_debug((count), (size), __FILE__, __LINE__)
+#define guava_free(p) guava_free_debug((p))
+#define guava_realloc(p, size) guava_realloc_debug((p), (size), __FILE__, __LINE__)
+
 #else
 
 #define guava_malloc(size) malloc((size))
@@ -32,4 +43,14 @@ size_t guava_malloc_size(void *p);
 
 #endif
 
+/*
+ * The counters below are only kept by the GUAVA_MEM_DEBUG allocator,
+ * guava_memory_stats returns GUAVA_FALSE in a normal build
+ */
+guava_bool_t guava_memory_stats(guava_mem_stats_t *stats);
+
+const guava_mem_site_t *guava_memory_site(size_t idx);
+
+void guava_memory_dump_leaks(FILE *fp);
+
 #endif /* !__GUAVA_MEMORY_H__ */
@@ -11,4 +11,6 @@
 
 const char *guava_mime_type_guess(const char *filename);
 
+guava_bool_t guava_mime_type_compressible(const char *mime_type);
+
 #endif /* !__GUAVA_MIME_TYPE_H__ */
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_MULTIPART_H__
+#define __GUAVA_MULTIPART_H__
+
+#include "guava.h"
+
+guava_bool_t guava_multipart_boundary(const char *content_type, size_t len, guava_string_t *boundary);
+
+void guava_multipart_parser_init(guava_multipart_parser_t *parser, guava_string_t boundary, size_t spill_size);
+
+void guava_multipart_parser_deinit(guava_multipart_parser_t *parser);
+
+void guava_multipart_parser_execute(guava_multipart_parser_t *parser, const char *buf, size_t len, PyObject *fields, PyObject *files);
+
+void guava_multipart_parser_finish(guava_multipart_parser_t *parser);
+
+int guava_multipart_parser_status(const guava_multipart_parser_t *parser);
+
+#endif /* !__GUAVA_MULTIPART_H__ */
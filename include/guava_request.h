@@ -37,6 +37,12 @@ void guava_request_free(guava_request_t *req);
 
 void guava_request_extract_from_url(guava_request_t *req);
 
-char *guava_request_parse_form_data(char **data, guava_string_t *name, guava_string_t *value);
+const char *guava_request_get_header(guava_request_t *req, const char *name, size_t *len);
+
+void guava_request_retain_headers(guava_request_t *req);
+
+void guava_request_retain(guava_request_t *req);
+
+PyObject *guava_request_headers_dict(guava_request_t *req);
 
 #endif /* !__GUAVA_REQUEST_H__ */
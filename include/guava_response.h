@@ -9,12 +9,14 @@
 
 #include "guava.h"
 
+#define GUAVA_STATUS_CODE_MAX 600
+
 typedef struct {
   int         code;
   const char *desc;
 } guava_status_code_t;
 
-guava_response_t *guava_response_new(void);
+guava_response_t *guava_response_new(guava_slab_t *slab);
 
 void guava_response_free(guava_response_t *resp);
 
@@ -30,14 +32,42 @@ void guava_response_set_cookie(guava_response_t *resp, const char *key, PyObject
 
 void guava_response_set_data(guava_response_t *resp, guava_string_t data);
 
+void guava_response_clear_data(guava_response_t *resp);
+
+void guava_response_set_file(guava_response_t *resp, uv_file file, int64_t offset, size_t size);
+
+void guava_response_set_cached_file(guava_response_t *resp, guava_file_t *file);
+
+void guava_response_hold_file(guava_response_t *resp, guava_file_t *file);
+
+void guava_response_write_file(guava_response_t *resp, int64_t offset, size_t size);
+
 void guava_response_write_data(guava_response_t *resp, const char *data);
 
-guava_string_t guava_response_serialize(guava_response_t *resp);
+void guava_response_write_data_size(guava_response_t *resp, const char *data, size_t len);
+
+int guava_response_write_object(guava_response_t *resp, PyObject *object);
+
+void guava_response_serialize(guava_response_t *resp);
 
-void guava_response_send(guava_response_t *resp, uv_write_cb cb);
+size_t guava_response_nbufs(guava_response_t *resp);
+
+size_t guava_response_bufs(guava_response_t *resp, uv_buf_t *bufs);
+
+void guava_response_send(guava_response_t *resp);
+
+void guava_response_park(guava_response_t *resp);
+
+void guava_response_unpark(guava_response_t *resp);
+
+void guava_response_resume(guava_response_t *resp);
+
+void guava_response_400(guava_response_t *resp, void *closure);
 
 void guava_response_404(guava_response_t *resp, void *closure);
 
+void guava_response_413(guava_response_t *resp, void *closure);
+
 void guava_response_500(guava_response_t *resp, void *closure);
 
 void guava_response_302(guava_response_t *resp, void *closure);
@@ -13,6 +13,10 @@ typedef struct {
   guava_router_t route;
   guava_string_t directory;
   guava_bool_t   allow_index;
+  size_t         memory_file_size; /* files up to this size are served from memory, 0 disables it */
+  guava_string_t cache_control;    /* sent along with the files, NULL for none */
+  guava_bool_t   gzip_static;      /* serve the .br or .gz file next to the one asked for */
+  guava_bool_t   gzip;             /* gzip compressible files without such a sibling once, in memory */
 } guava_router_static_t;
 
 typedef struct {
@@ -32,14 +36,20 @@ guava_router_t *guava_router_new(void);
 void guava_router_free(guava_router_t *router);
 
 void guava_router_set_mount_point(guava_router_t *router, const char *mount_point);
+unsigned long guava_router_generation(void);
 void guava_router_set_package(guava_router_t *router, const char *package);
 void guava_router_set_session_store(guava_router_t *router, guava_session_store_t *store);
 void guava_router_set_routes(guava_router_t *router, PyObject *routes);
+PyObject *guava_router_custom_route(guava_router_t *router, guava_request_t *req);
 
 guava_router_static_t *guava_router_static_new(void);
 void guava_router_static_free(guava_router_static_t *router);
 void guava_router_static_set_directory(guava_router_static_t *router, const char *directory);
 void guava_router_static_set_allow_index(guava_router_static_t *router, const guava_bool_t allow_index);
+void guava_router_static_set_memory_file_size(guava_router_static_t *router, size_t size);
+void guava_router_static_set_cache_control(guava_router_static_t *router, const char *cache_control);
+void guava_router_static_set_gzip_static(guava_router_static_t *router, const guava_bool_t gzip_static);
+void guava_router_static_set_gzip(guava_router_static_t *router, const guava_bool_t gzip);
 void guava_router_static_route(guava_router_static_t *router, guava_request_t *req, guava_handler_t *handler);
 
 guava_router_mvc_t *guava_router_mvc_new(void);
@@ -50,6 +60,8 @@ guava_router_rest_t *guava_router_rest_new(void);
 void guava_router_rest_free(guava_router_rest_t *router);
 void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req, guava_handler_t *handler);
 
-PyObject *guava_router_get_best_matched_router(PyObject *routers, PyObject *request);
+PyObject *guava_router_get_best_matched_router(guava_server_t *server, PyObject *request);
+PyObject *guava_router_native_route(guava_router_t *router, guava_request_t *req);
+PyObject *guava_router_route(guava_server_t *server, PyObject *request);
 
 #endif /* !__GUAVA_ROUTER_H__ */
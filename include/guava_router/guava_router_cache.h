@@ -0,0 +1,22 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_ROUTER_CACHE_H__
+#define __GUAVA_ROUTER_CACHE_H__
+
+#include "guava.h"
+
+guava_router_cache_t *guava_router_cache_new(size_t capacity);
+
+void guava_router_cache_free(guava_router_cache_t *cache);
+
+void guava_router_cache_clear(guava_router_cache_t *cache);
+
+guava_handler_t *guava_router_cache_get(guava_router_cache_t *cache, int method, const char *key, size_t len);
+
+void guava_router_cache_put(guava_router_cache_t *cache, int method, const char *key, size_t len, guava_handler_t *handler);
+
+#endif /* !__GUAVA_ROUTER_CACHE_H__ */
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_ROUTER_TEMPLATE_H__
+#define __GUAVA_ROUTER_TEMPLATE_H__
+
+#include "guava.h"
+
+guava_bool_t guava_router_template_is_template(const char *path);
+
+guava_router_template_t *guava_router_template_new(void);
+
+void guava_router_template_free(guava_router_template_t *tree);
+
+guava_bool_t guava_router_template_insert(guava_router_template_t *tree, const char *path, PyObject *handler);
+
+PyObject *guava_router_template_match(guava_router_template_t *tree, const char *path, size_t len, PyObject **args);
+
+guava_router_template_t *guava_router_template_compile(PyObject *routes);
+
+#endif /* !__GUAVA_ROUTER_TEMPLATE_H__ */
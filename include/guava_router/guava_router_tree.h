@@ -0,0 +1,22 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_ROUTER_TREE_H__
+#define __GUAVA_ROUTER_TREE_H__
+
+#include "guava.h"
+
+guava_router_node_t *guava_router_tree_new(void);
+
+void guava_router_tree_free(guava_router_node_t *tree);
+
+void guava_router_tree_insert(guava_router_node_t *tree, const char *mount_point, size_t len, PyObject *router);
+
+PyObject *guava_router_tree_match(guava_router_node_t *tree, const char *path, size_t len);
+
+guava_router_node_t *guava_router_tree_compile(PyObject *routers);
+
+#endif /* !__GUAVA_ROUTER_TREE_H__ */
@@ -0,0 +1,20 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_SLAB_H__
+#define __GUAVA_SLAB_H__
+
+#include "guava.h"
+
+void guava_slab_init(guava_slab_t *slab, size_t size, size_t high_water);
+
+void guava_slab_deinit(guava_slab_t *slab);
+
+void *guava_slab_alloc(guava_slab_t *slab);
+
+void guava_slab_free(guava_slab_t *slab, void *p);
+
+#endif /* !__GUAVA_SLAB_H__ */
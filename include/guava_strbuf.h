@@ -0,0 +1,38 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_STRBUF_H__
+#define __GUAVA_STRBUF_H__
+
+#include "guava.h"
+
+void guava_strbuf_init(guava_strbuf_t *buf);
+
+void guava_strbuf_init_borrowed(guava_strbuf_t *buf, char *mem, size_t size);
+
+void guava_strbuf_deinit(guava_strbuf_t *buf);
+
+void guava_strbuf_clear(guava_strbuf_t *buf);
+
+guava_bool_t guava_strbuf_reserve(guava_strbuf_t *buf, size_t len);
+
+void guava_strbuf_append(guava_strbuf_t *buf, const char *s, size_t len);
+
+void guava_strbuf_append_raw(guava_strbuf_t *buf, const char *s);
+
+void guava_strbuf_append_char(guava_strbuf_t *buf, char c);
+
+void guava_strbuf_append_uint(guava_strbuf_t *buf, uint64_t v);
+
+void guava_strbuf_append_int(guava_strbuf_t *buf, int64_t v);
+
+void guava_strbuf_append_fmt(guava_strbuf_t *buf, const char *fmt, ...);
+
+guava_string_t guava_strbuf_to_string(guava_strbuf_t *buf);
+
+void guava_strbuf_from_string(guava_strbuf_t *buf, guava_string_t gs);
+
+#endif /* !__GUAVA_STRBUF_H__ */
@@ -10,6 +10,8 @@
 #include "guava.h"
 
 #define GUAVA_STRING_CONST 0x01
+#define GUAVA_STRING_ARENA 0x02 /* released with its arena, guava_string_free ignores it */
+#define GUAVA_STRING_GROWN 0x04 /* room rounded up to a power of two by an append */
 
 static inline size_t guava_string_len(const guava_string_t gs) {
   guava_string_header_t *h = (guava_string_header_t *)((char *)gs - sizeof(guava_string_header_t));
@@ -28,6 +30,12 @@ guava_string_t guava_string_append_raw_size(const guava_string_t gs, const char
 
 guava_string_t guava_string_append_int(const guava_string_t gs, int i);
 
+guava_string_t guava_string_arena_new_size(guava_arena_t *arena, const char *init, size_t len);
+
+guava_string_t guava_string_arena_append_raw_size(guava_arena_t *arena, const guava_string_t gs, const char *s, size_t len);
+
+guava_bool_t guava_string_is_arena(const guava_string_t gs);
+
 guava_bool_t guava_string_starts_with(const guava_string_t s1, const guava_string_t s2);
 
 guava_bool_t guava_string_equal_raw(const guava_string_t s, const char *s2);
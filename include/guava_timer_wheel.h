@@ -0,0 +1,24 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#ifndef __GUAVA_TIMER_WHEEL_H__
+#define __GUAVA_TIMER_WHEEL_H__
+
+#include "guava.h"
+
+void guava_timer_wheel_init(guava_timer_wheel_t *wheel, uv_loop_t *loop);
+
+void guava_timer_wheel_close(guava_timer_wheel_t *wheel);
+
+void guava_timer_init(guava_timer_t *timer);
+
+guava_bool_t guava_timer_is_active(guava_timer_t *timer);
+
+void guava_timer_wheel_add(guava_timer_wheel_t *wheel, guava_timer_t *timer, unsigned int timeout, guava_timer_cb cb);
+
+void guava_timer_wheel_remove(guava_timer_wheel_t *wheel, guava_timer_t *timer);
+
+#endif /* !__GUAVA_TIMER_WHEEL_H__ */
@@ -10,23 +10,35 @@ SRC_FOLDER = './src/'
 os.system("./build.sh")
 
 guava_sources =[ SRC_FOLDER + name for name in [
+    'guava_arena.c',
     'guava_conn.c',
+    'guava_dispatch.c',
+    'guava_file_cache.c',
     'guava_handler/guava_handler.c',
     'guava_handler/guava_handler_static.c',
+    'guava_form.c',
+    'guava_header.c',
     'guava_mime_type.c',
+    'guava_multipart.c',
     'guava_request.c',
     'guava_response.c',
     'guava_router/guava_router.c',
+    'guava_router/guava_router_cache.c',
     'guava_router/guava_router_mvc.c',
     'guava_router/guava_router_rest.c',
     'guava_router/guava_router_static.c',
+    'guava_router/guava_router_template.c',
+    'guava_router/guava_router_tree.c',
     'guava_server.c',
+    'guava_strbuf.c',
     'guava_string.c',
     'guava_session/guava_session.c',
     'guava_session/guava_session_store_inmem.c',
     'guava_session/guava_session_store_file.c',
     'guava_cookie.c',
     'guava_memory.c',
+    'guava_slab.c',
+    'guava_timer_wheel.c',
     'guava_url.c',
 ]]
 
@@ -62,9 +74,10 @@ guava_module = Extension('guava',
                              SRC_FOLDER + 'guava_module/guava_module_session.c',
                              SRC_FOLDER + 'guava_module/guava_module.c',
                              SRC_FOLDER + 'guava_module/guava_module_cookie.c',
+                             SRC_FOLDER + 'guava_module/guava_module_memory.c',
                          ],
                          include_dirs=['./include/'] + http_parser_include + libuv_include,
-                         libraries=[] + libraries,
+                         libraries=['z'] + libraries,
                          define_macros=macros,
                          extra_compile_args=compile_flags,
                          extra_objects=['./deps/libuv/.libs/libuv.a'])
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_arena.h"
+#include "guava_memory.h"
+
+#define GUAVA_ARENA_ALIGN(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+void guava_arena_init(guava_arena_t *arena) {
+  memset(arena, 0, sizeof(*arena));
+}
+
+void guava_arena_deinit(guava_arena_t *arena) {
+  guava_arena_chunk_t *chunk = arena->chunks;
+  while (chunk) {
+    guava_arena_chunk_t *next = chunk->next;
+    guava_free(chunk);
+    chunk = next;
+  }
+
+  arena->chunks = NULL;
+  arena->last = NULL;
+  arena->last_size = 0;
+  arena->allocated = 0;
+}
+
+static void *guava_arena_alloc_reserve(guava_arena_t *arena, size_t size, size_t reserve) {
+  size_t aligned = GUAVA_ARENA_ALIGN(size);
+  guava_arena_chunk_t *chunk = arena->chunks;
+
+  if (!chunk || chunk->size - chunk->used < aligned) {
+    size_t chunk_size = GUAVA_CONN_ARENA_CHUNK_SIZE;
+    if (chunk_size < reserve) {
+      chunk_size = GUAVA_ARENA_ALIGN(reserve);
+    }
+
+    chunk = (guava_arena_chunk_t *)guava_malloc(sizeof(guava_arena_chunk_t) + chunk_size);
+    if (!chunk) {
+      return NULL;
+    }
+
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  char *p = chunk->data + chunk->used;
+  chunk->used += aligned;
+  arena->allocated += aligned;
+
+  arena->last = p;
+  arena->last_size = aligned;
+
+  return p;
+}
+
+void *guava_arena_alloc(guava_arena_t *arena, size_t size) {
+  return guava_arena_alloc_reserve(arena, size, size);
+}
+
+void *guava_arena_realloc(guava_arena_t *arena, void *p, size_t old_size, size_t size) {
+  if (!p) {
+    return guava_arena_alloc(arena, size);
+  }
+
+  /* The latest allocation grows in place while its chunk has room */
+  guava_arena_chunk_t *chunk = arena->chunks;
+  if (p == arena->last) {
+    size_t aligned = GUAVA_ARENA_ALIGN(size);
+    size_t start = (char *)p - chunk->data;
+    if (aligned <= chunk->size - start) {
+      chunk->used = start + aligned;
+      arena->allocated += aligned - arena->last_size;
+      arena->last_size = aligned;
+      return p;
+    }
+  }
+
+  /* Leave room for growing further, like url and header_data do */
+  void *np = guava_arena_alloc_reserve(arena, size, size * 2);
+  if (!np) {
+    return NULL;
+  }
+
+  memcpy(np, p, old_size < size ? old_size : size);
+  return np;
+}
+
+void guava_arena_reset(guava_arena_t *arena) {
+  if (arena->allocated > arena->high_water) {
+    arena->high_water = arena->allocated;
+  }
+
+  /* Only the first chunk is kept, bigger requests don't pin their memory */
+  guava_arena_chunk_t *chunk = arena->chunks;
+  while (chunk && chunk->next) {
+    guava_arena_chunk_t *next = chunk->next;
+    guava_free(chunk);
+    chunk = next;
+  }
+
+  if (chunk && chunk->size > GUAVA_CONN_ARENA_CHUNK_SIZE) {
+    guava_free(chunk);
+    chunk = NULL;
+  }
+
+  if (chunk) {
+    chunk->used = 0;
+  }
+
+  arena->chunks = chunk;
+  arena->last = NULL;
+  arena->last_size = 0;
+  arena->allocated = 0;
+}
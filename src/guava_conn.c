@@ -7,14 +7,32 @@
 #include "guava_conn.h"
 #include "guava_string.h"
 #include "guava_request.h"
+#include "guava_response.h"
 #include "guava_memory.h"
+#include "guava_slab.h"
+#include "guava_server.h"
+#include "guava_timer_wheel.h"
+#include "guava_arena.h"
 
-guava_conn_t *guava_conn_new() {
-  guava_conn_t *conn = (guava_conn_t *)guava_calloc(1, sizeof(guava_conn_t));
+#if defined(__APPLE__)
+extern int uv___stream_fd(const uv_stream_t* handle);
+#else
+#define uv___stream_fd(handle) ((handle)->io_watcher.fd)
+#endif
+
+#define GUAVA_LIBUV_GET_STREAM_FD uv___stream_fd
+
+guava_conn_t *guava_conn_new(guava_server_t *server) {
+  guava_conn_t *conn = (guava_conn_t *)guava_slab_alloc(&server->conns);
   if (!conn) {
     return NULL;
   }
 
+  memset(conn, 0, sizeof(*conn));
+  conn->server = server;
+  guava_timer_init(&conn->timer);
+  guava_arena_init(&conn->arena);
+
   conn->parser_settings.on_message_begin = guava_request_on_message_begin;
   conn->parser_settings.on_url = guava_request_on_url;
   conn->parser_settings.on_header_field = guava_request_on_header_field;
@@ -25,14 +43,374 @@ guava_conn_t *guava_conn_new() {
   return conn;
 }
 
+static void guava_conn_free_responses(guava_response_t *resp) {
+  while (resp) {
+    guava_response_t *next = resp->next;
+    guava_response_free(resp);
+    resp = next;
+  }
+}
+
 void guava_conn_free(guava_conn_t *conn) {
+  guava_timer_wheel_remove(&conn->server->timers, &conn->timer);
+
+  guava_conn_free_responses(conn->pending);
+  guava_conn_free_responses(conn->writing);
+
   if (conn->request) {
+    if (Py_REFCNT(conn->request) > 1) {
+      guava_request_retain(((Request *)conn->request)->req);
+    }
     Py_DECREF(conn->request);
   }
 
-  if (conn->auxiliary_current_header) {
-    guava_string_free(conn->auxiliary_current_header);
+  guava_arena_deinit(&conn->arena);
+
+  guava_slab_free(&conn->server->conns, conn);
+}
+
+/* Frees a closed conn once nothing running on the loop points to it anymore */
+guava_bool_t guava_conn_release(guava_conn_t *conn) {
+  if (!conn->closed || conn->sending || conn->parked || conn->poll_open) {
+    return GUAVA_FALSE;
+  }
+
+  guava_conn_free(conn);
+  return GUAVA_TRUE;
+}
+
+static void guava_conn_on_timeout(guava_timer_t *timer) {
+  guava_conn_t *conn = container_of(timer, guava_conn_t, timer);
+
+  if (!uv_is_closing((uv_handle_t *)&conn->stream)) {
+    uv_close((uv_handle_t *)&conn->stream, guava_server_on_close);
+  }
+}
+
+void guava_conn_set_timeout(guava_conn_t *conn, int timeout) {
+  if (timeout <= 0) {
+    guava_timer_wheel_remove(&conn->server->timers, &conn->timer);
+    return;
+  }
+
+  guava_timer_wheel_add(&conn->server->timers, &conn->timer, (unsigned int)timeout, guava_conn_on_timeout);
+}
+
+static void guava_conn_close(guava_conn_t *conn) {
+  if (!uv_is_closing((uv_handle_t *)&conn->stream)) {
+    uv_close((uv_handle_t *)&conn->stream, guava_server_on_close);
+  }
+}
+
+static void guava_conn_after_write(guava_conn_t *conn, uint8_t keep_alive) {
+  if (!keep_alive || uv_is_closing((uv_handle_t *)&conn->stream)) {
+    guava_conn_close(conn);
+    return;
+  }
+
+  if (conn->pending) {
+    guava_conn_flush(conn);
+  } else if (!conn->request) {
+    guava_conn_set_timeout(conn, conn->server->keepalive_timeout);
+  } else {
+    /* A pipelined request is partly read, the timeout of its phase takes over again */
+    guava_conn_set_timeout(conn, conn->in_body ? conn->server->body_timeout : conn->server->header_timeout);
+  }
+}
+
+static void guava_conn_on_sendfile(uv_fs_t *req);
+
+static void guava_conn_send_file(guava_conn_t *conn) {
+  guava_response_t *resp = conn->sending;
+
+  uv_fs_sendfile(&conn->server->loop, &conn->sendfile_req,
+                 GUAVA_LIBUV_GET_STREAM_FD((uv_stream_t *)&conn->stream),
+                 resp->file, resp->file_offset, resp->file_size, guava_conn_on_sendfile);
+}
+
+static void guava_conn_abort_send(guava_conn_t *conn) {
+  guava_response_t *resp = conn->sending;
+
+  conn->sending = NULL;
+  guava_response_free(resp);
+  guava_conn_close(conn);
+}
+
+static void guava_conn_on_poll_close(uv_handle_t *handle) {
+  guava_conn_t *conn = container_of(handle, guava_conn_t, poll);
+
+  close(conn->poll_fd);
+  conn->poll_open = 0;
+
+  if (conn->polling) {
+    /* Nothing resumes the sendfile waiting on the poll anymore */
+    guava_response_t *resp = conn->sending;
+    conn->polling = 0;
+    conn->sending = NULL;
+    guava_response_free(resp);
+  }
+
+  guava_conn_release(conn);
+}
+
+void guava_conn_close_poll(guava_conn_t *conn) {
+  if (conn->poll_open && !uv_is_closing((uv_handle_t *)&conn->poll)) {
+    uv_close((uv_handle_t *)&conn->poll, guava_conn_on_poll_close);
+  }
+}
+
+static void guava_conn_on_writable(uv_poll_t *handle, int status, int events) {
+  guava_conn_t *conn = container_of(handle, guava_conn_t, poll);
+
+  uv_poll_stop(handle);
+
+  if (uv_is_closing((uv_handle_t *)&conn->stream)) {
+    /* The poll close callback drops the response */
+    return;
+  }
+
+  conn->polling = 0;
+
+  if (status < 0) {
+    guava_conn_abort_send(conn);
+    return;
+  }
+
+  guava_conn_send_file(conn);
+}
+
+/* The socket buffer is full, the sendfile is retried once it drained */
+static void guava_conn_wait_writable(guava_conn_t *conn) {
+  if (!conn->poll_open) {
+    int fd = dup(GUAVA_LIBUV_GET_STREAM_FD((uv_stream_t *)&conn->stream));
+    if (fd < 0) {
+      guava_conn_abort_send(conn);
+      return;
+    }
+
+    if (uv_poll_init(&conn->server->loop, &conn->poll, fd) < 0) {
+      close(fd);
+      guava_conn_abort_send(conn);
+      return;
+    }
+
+    conn->poll_fd = fd;
+    conn->poll_open = 1;
+  }
+
+  conn->polling = 1;
+  uv_poll_start(&conn->poll, UV_WRITABLE, guava_conn_on_writable);
+}
+
+static void guava_conn_send_part(guava_conn_t *conn);
+
+static void guava_conn_on_tail_write(uv_write_t *req, int status);
+
+/* The range of the current part is out, sends whatever follows it */
+static void guava_conn_finish_part(guava_conn_t *conn) {
+  guava_response_t *resp = conn->sending;
+
+  /* Whatever follows the range, a multipart boundary for one */
+  guava_response_part_t *part = &resp->parts[resp->part];
+  if (part->tail_len > 0) {
+    uv_buf_t buf = uv_buf_init(resp->tails.data + part->tail_off, (unsigned int)part->tail_len);
+    uv_write(&conn->write_req, (uv_stream_t *)&conn->stream, &buf, 1, guava_conn_on_tail_write);
+    return;
+  }
+
+  ++resp->part;
+  guava_conn_send_part(conn);
+}
+
+/* Starts on the next part of the sending response, or finishes it */
+static void guava_conn_send_part(guava_conn_t *conn) {
+  guava_response_t *resp = conn->sending;
+
+  if (resp->part < resp->nparts) {
+    guava_response_part_t *part = &resp->parts[resp->part];
+    resp->file_offset = part->offset;
+    resp->file_size = part->size;
+    if (resp->file_size == 0) {
+      guava_conn_finish_part(conn);
+      return;
+    }
+    guava_conn_send_file(conn);
+    return;
+  }
+
+  conn->sending = NULL;
+  uint8_t keep_alive = resp->keep_alive;
+  guava_response_free(resp);
+  guava_conn_after_write(conn, keep_alive);
+}
+
+static void guava_conn_on_tail_write(uv_write_t *req, int status) {
+  guava_conn_t *conn = container_of(req, guava_conn_t, write_req);
+  guava_response_t *resp = conn->sending;
+
+  if (conn->closed) {
+    conn->sending = NULL;
+    guava_response_free(resp);
+    guava_conn_release(conn);
+    return;
+  }
+
+  if (status < 0) {
+    guava_conn_abort_send(conn);
+    return;
+  }
+
+  ++resp->part;
+  guava_conn_send_part(conn);
+}
+
+static void guava_conn_on_sendfile(uv_fs_t *req) {
+  guava_conn_t *conn = container_of(req, guava_conn_t, sendfile_req);
+  guava_response_t *resp = conn->sending;
+  ssize_t result = req->result;
+
+  uv_fs_req_cleanup(req);
+
+  if (conn->closed) {
+    conn->sending = NULL;
+    guava_response_free(resp);
+    guava_conn_release(conn);
+    return;
+  }
+
+  if (result == UV_EAGAIN) {
+    guava_conn_wait_writable(conn);
+    return;
+  }
+
+  if (result == 0) {
+    /* The file got shorter than the length already promised to the client */
+    fprintf(stderr, "sendfile error: unexpected end of file\n");
+    guava_conn_abort_send(conn);
+    return;
   }
 
-  guava_free(conn);
+  if (result < 0) {
+    fprintf(stderr, "sendfile error: %s\n", uv_strerror((int)result));
+    guava_conn_abort_send(conn);
+    return;
+  }
+
+  /* The client keeps reading, so the write timeout starts over */
+  guava_conn_set_timeout(conn, conn->server->write_timeout);
+
+  if ((size_t)result < resp->file_size) {
+    resp->file_offset += result;
+    resp->file_size -= (size_t)result;
+    guava_conn_send_file(conn);
+    return;
+  }
+
+  guava_conn_finish_part(conn);
+}
+
+static void guava_conn_on_write(uv_write_t *req, int status) {
+  guava_conn_t *conn = container_of(req, guava_conn_t, write_req);
+  guava_response_t *resp = conn->writing;
+  uint8_t keep_alive = 1;
+
+  conn->writing = NULL;
+
+  if (status < 0) {
+    guava_conn_free_responses(resp);
+    guava_conn_close(conn);
+    return;
+  }
+
+  while (resp) {
+    guava_response_t *next = resp->next;
+    keep_alive = resp->keep_alive;
+
+    if (resp->nparts && !next) {
+      /* The headers are out, the rest of the body goes straight from the file */
+      conn->sending = resp;
+      resp->part = 0;
+      guava_conn_send_part(conn);
+      return;
+    }
+
+    guava_response_free(resp);
+    resp = next;
+  }
+
+  guava_conn_after_write(conn, keep_alive);
+}
+
+void guava_conn_queue_response(guava_conn_t *conn, guava_response_t *resp) {
+  resp->next = NULL;
+
+  if (conn->pending_tail) {
+    conn->pending_tail->next = resp;
+  } else {
+    conn->pending = resp;
+  }
+  conn->pending_tail = resp;
+
+  if (!conn->in_read) {
+    guava_conn_flush(conn);
+  }
+}
+
+void guava_conn_flush(guava_conn_t *conn) {
+  uv_buf_t bufs[GUAVA_CONN_MAX_WRITE_BUFS];
+  uv_buf_t *p = bufs;
+  size_t nbufs = 0;
+
+  if (conn->writing || conn->sending || !conn->pending || conn->pending->parked) {
+    return;
+  }
+
+  if (uv_is_closing((uv_handle_t *)&conn->stream)) {
+    return;
+  }
+
+  /*
+   * Coalesce the queued responses into one write, stopping after a response
+   * with a file body or one closing the connection, and before a parked one.
+   */
+  guava_response_t *last = NULL;
+  for (guava_response_t *resp = conn->pending; resp && !resp->parked; resp = resp->next) {
+    if (last && nbufs + guava_response_nbufs(resp) > GUAVA_CONN_MAX_WRITE_BUFS) {
+      break;
+    }
+    nbufs += guava_response_nbufs(resp);
+    last = resp;
+    if (resp->nparts || !resp->keep_alive) {
+      break;
+    }
+  }
+
+  if (nbufs > GUAVA_CONN_MAX_WRITE_BUFS) {
+    /* One response with a lot of body segments, uv_write copies the bufs */
+    p = (uv_buf_t *)guava_malloc(nbufs * sizeof(uv_buf_t));
+    if (!p) {
+      guava_conn_close(conn);
+      return;
+    }
+  }
+
+  nbufs = 0;
+  for (guava_response_t *resp = conn->pending; resp != last->next; resp = resp->next) {
+    nbufs += guava_response_bufs(resp, p + nbufs);
+  }
+
+  conn->writing = conn->pending;
+  conn->pending = last->next;
+  if (!conn->pending) {
+    conn->pending_tail = NULL;
+  }
+  last->next = NULL;
+
+  guava_conn_set_timeout(conn, conn->server->write_timeout);
+
+  uv_write(&conn->write_req, (uv_stream_t *)&conn->stream, p, (unsigned int)nbufs, guava_conn_on_write);
+
+  if (p != bufs) {
+    guava_free(p);
+  }
 }
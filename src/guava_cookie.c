@@ -6,6 +6,7 @@
 
 #include "guava_cookie.h"
 #include "guava_string.h"
+#include "guava_strbuf.h"
 #include "guava_module.h"
 #include "guava_memory.h"
 
@@ -239,3 +240,37 @@ PyObject *guava_cookie_parse(char **data) {
 
   return (PyObject *)cookie;
 }
+
+void guava_cookie_render(guava_cookie_t *cookie, guava_strbuf_t *buf) {
+  guava_strbuf_append_raw(buf, cookie->name);
+  guava_strbuf_append_char(buf, '=');
+  guava_strbuf_append_raw(buf, cookie->value);
+
+  if (cookie->domain) {
+    guava_strbuf_append_raw(buf, " ;Domain=");
+    guava_strbuf_append_raw(buf, cookie->domain);
+  }
+
+  if (cookie->path) {
+    guava_strbuf_append_raw(buf, " ;Path=");
+    guava_strbuf_append_raw(buf, cookie->path);
+  }
+
+  if (cookie->expired >= 0) {
+    guava_strbuf_append_raw(buf, " ;Expires=");
+    guava_strbuf_append_int(buf, cookie->expired);
+  }
+
+  if (cookie->max_age >= 0) {
+    guava_strbuf_append_raw(buf, " ;Max-Age=");
+    guava_strbuf_append_int(buf, cookie->max_age);
+  }
+
+  if (cookie->secure) {
+    guava_strbuf_append_raw(buf, " ;Secure");
+  }
+
+  if (cookie->httponly) {
+    guava_strbuf_append_raw(buf, " ;HttpOnly");
+  }
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_dispatch.h"
+#include "guava_string.h"
+#include "guava_memory.h"
+
+#define GUAVA_DISPATCH_INITIAL_BUCKETS 64
+
+/* Controller classes are process wide, so is the cache */
+static guava_dispatch_cache_t guava_dispatch = {NULL, 0, 0, 0, 0};
+
+static PyObject *guava_dispatch_before_action = NULL;
+static PyObject *guava_dispatch_after_action = NULL;
+
+static uint32_t guava_dispatch_hash_string(uint32_t hash, guava_string_t s) {
+  /* FNV-1a, the terminating NUL separates the fields */
+  size_t len = s ? guava_string_len(s) : 0;
+  for (size_t i = 0; i <= len; ++i) {
+    hash ^= (uint8_t)(i < len ? s[i] : 0);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t guava_dispatch_hash(guava_handler_t *handler) {
+  uint32_t hash = 2166136261u;
+  hash = guava_dispatch_hash_string(hash, handler->package);
+  hash = guava_dispatch_hash_string(hash, handler->module);
+  hash = guava_dispatch_hash_string(hash, handler->cls);
+  hash = guava_dispatch_hash_string(hash, handler->action);
+  return hash;
+}
+
+static guava_bool_t guava_dispatch_string_equal(guava_string_t a, guava_string_t b) {
+  if (!a || !b) {
+    return a == b;
+  }
+  return guava_string_len(a) == guava_string_len(b) && memcmp(a, b, guava_string_len(a)) == 0;
+}
+
+static guava_bool_t guava_dispatch_entry_match(guava_dispatch_entry_t *entry, uint32_t hash, guava_handler_t *handler) {
+  return entry->hash == hash &&
+    guava_dispatch_string_equal(entry->package, handler->package) &&
+    guava_dispatch_string_equal(entry->module, handler->module) &&
+    guava_dispatch_string_equal(entry->cls, handler->cls) &&
+    guava_dispatch_string_equal(entry->action, handler->action);
+}
+
+static guava_string_t guava_dispatch_string_copy(guava_string_t s) {
+  return s ? guava_string_new_size(s, guava_string_len(s)) : NULL;
+}
+
+static void guava_dispatch_entry_free(guava_dispatch_entry_t *entry) {
+  if (entry->package) {
+    guava_string_free(entry->package);
+  }
+  if (entry->module) {
+    guava_string_free(entry->module);
+  }
+  if (entry->cls) {
+    guava_string_free(entry->cls);
+  }
+  if (entry->action) {
+    guava_string_free(entry->action);
+  }
+  /* After Py_Finalize the classes are gone with the interpreter */
+  if (Py_IsInitialized()) {
+    Py_XDECREF(entry->cls_object);
+    Py_XDECREF(entry->action_name);
+  }
+  guava_free(entry);
+}
+
+static void guava_dispatch_grow(void) {
+  size_t nbuckets = guava_dispatch.nbuckets ? guava_dispatch.nbuckets * 2 : GUAVA_DISPATCH_INITIAL_BUCKETS;
+  guava_dispatch_entry_t **buckets = (guava_dispatch_entry_t **)guava_calloc(nbuckets, sizeof(*buckets));
+  if (!buckets) {
+    return;
+  }
+
+  for (size_t i = 0; i < guava_dispatch.nbuckets; ++i) {
+    guava_dispatch_entry_t *entry = guava_dispatch.buckets[i];
+    while (entry) {
+      guava_dispatch_entry_t *next = entry->next;
+      size_t idx = entry->hash & (nbuckets - 1);
+      entry->next = buckets[idx];
+      buckets[idx] = entry;
+      entry = next;
+    }
+  }
+
+  guava_free(guava_dispatch.buckets);
+  guava_dispatch.buckets = buckets;
+  guava_dispatch.nbuckets = nbuckets;
+}
+
+static PyObject *guava_dispatch_import(guava_handler_t *handler) {
+  PyObject *module_name = NULL;
+  if (guava_string_equal_raw(handler->package, ".")) {
+    module_name = PyString_FromString(handler->module);
+  } else {
+    module_name = PyString_FromFormat("%s.%s", handler->package, handler->module);
+  }
+
+  PyObject *module = PyImport_Import(module_name);
+
+  if (!module) {
+    fprintf(stderr, "no module named: %s\n", PyString_AsString(module_name));
+    Py_DECREF(module_name);
+    return NULL;
+  }
+  Py_DECREF(module_name);
+
+  PyObject *cls = PyObject_GetAttrString(module, handler->cls);
+  Py_DECREF(module);
+
+  if (!cls) {
+    fprintf(stderr, "no cls named: %s\n", handler->cls);
+    return NULL;
+  }
+
+  return cls;
+}
+
+guava_dispatch_entry_t *guava_dispatch_lookup(guava_handler_t *handler) {
+  uint32_t hash = guava_dispatch_hash(handler);
+
+  if (guava_dispatch.nbuckets) {
+    guava_dispatch_entry_t *entry = guava_dispatch.buckets[hash & (guava_dispatch.nbuckets - 1)];
+    for (; entry; entry = entry->next) {
+      if (guava_dispatch_entry_match(entry, hash, handler)) {
+        ++guava_dispatch.hits;
+        return entry;
+      }
+    }
+  }
+
+  ++guava_dispatch.misses;
+
+  PyObject *cls = guava_dispatch_import(handler);
+  if (!cls) {
+    return NULL;
+  }
+
+  guava_dispatch_entry_t *entry = (guava_dispatch_entry_t *)guava_calloc(1, sizeof(guava_dispatch_entry_t));
+  if (!entry) {
+    Py_DECREF(cls);
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  entry->hash = hash;
+  entry->package = guava_dispatch_string_copy(handler->package);
+  entry->module = guava_dispatch_string_copy(handler->module);
+  entry->cls = guava_dispatch_string_copy(handler->cls);
+  entry->action = guava_dispatch_string_copy(handler->action);
+  entry->cls_object = cls;
+  entry->action_name = PyString_InternFromString(handler->action ? handler->action : "index");
+
+  if (guava_dispatch.count >= guava_dispatch.nbuckets * 3 / 4) {
+    guava_dispatch_grow();
+  }
+
+  if (!guava_dispatch.nbuckets) {
+    guava_dispatch_entry_free(entry);
+    PyErr_NoMemory();
+    return NULL;
+  }
+
+  size_t idx = hash & (guava_dispatch.nbuckets - 1);
+  entry->next = guava_dispatch.buckets[idx];
+  guava_dispatch.buckets[idx] = entry;
+  ++guava_dispatch.count;
+
+  return entry;
+}
+
+void guava_dispatch_invalidate(void) {
+  for (size_t i = 0; i < guava_dispatch.nbuckets; ++i) {
+    guava_dispatch_entry_t *entry = guava_dispatch.buckets[i];
+    while (entry) {
+      guava_dispatch_entry_t *next = entry->next;
+      guava_dispatch_entry_free(entry);
+      entry = next;
+    }
+    guava_dispatch.buckets[i] = NULL;
+  }
+
+  guava_dispatch.count = 0;
+}
+
+void guava_dispatch_free(void) {
+  guava_dispatch_invalidate();
+
+  guava_free(guava_dispatch.buckets);
+  guava_dispatch.buckets = NULL;
+  guava_dispatch.nbuckets = 0;
+}
+
+guava_dispatch_cache_t *guava_dispatch_cache(void) {
+  return &guava_dispatch;
+}
+
+PyObject *guava_dispatch_before_action_name(void) {
+  if (!guava_dispatch_before_action) {
+    guava_dispatch_before_action = PyString_InternFromString("before_action");
+  }
+  return guava_dispatch_before_action;
+}
+
+PyObject *guava_dispatch_after_action_name(void) {
+  if (!guava_dispatch_after_action) {
+    guava_dispatch_after_action = PyString_InternFromString("after_action");
+  }
+  return guava_dispatch_after_action;
+}
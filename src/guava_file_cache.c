@@ -0,0 +1,450 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_file_cache.h"
+#include "guava_string.h"
+#include "guava_strbuf.h"
+#include "guava_memory.h"
+
+static uint32_t guava_file_cache_hash(const char *key, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)key[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void guava_file_cache_init(guava_file_cache_t *cache, uv_loop_t *loop, size_t capacity, size_t memory_budget) {
+  memset(cache, 0, sizeof(*cache));
+  cache->loop = loop;
+  cache->memory_budget = memory_budget;
+
+  if (capacity == 0) {
+    return;
+  }
+
+  cache->nbuckets = 16;
+  while (cache->nbuckets < capacity) {
+    cache->nbuckets <<= 1;
+  }
+
+  cache->buckets = (guava_file_t **)guava_calloc(cache->nbuckets, sizeof(guava_file_t *));
+  if (cache->buckets) {
+    cache->capacity = capacity;
+  }
+}
+
+static void guava_file_on_close(uv_fs_t *req) {
+  uv_fs_req_cleanup(req);
+  guava_free(req);
+}
+
+/* close() may block while it flushes, on NFS for one, so it runs on the threadpool too */
+void guava_file_close_async(uv_loop_t *loop, uv_file fd) {
+  uv_fs_t *req = (uv_fs_t *)guava_malloc(sizeof(uv_fs_t));
+
+  if (!req || uv_fs_close(loop, req, fd, guava_file_on_close) < 0) {
+    guava_free(req);
+    close(fd);
+  }
+}
+
+void guava_file_retain(guava_file_t *file) {
+  ++file->refcnt;
+}
+
+void guava_file_release(guava_file_t *file) {
+  if (--file->refcnt > 0) {
+    return;
+  }
+
+  if (file->fd >= 0) {
+    guava_file_close_async(file->cache->loop, file->fd);
+  }
+
+  guava_free(file->data);
+  guava_string_free(file->headers);
+  guava_string_free(file->path);
+  guava_free(file);
+}
+
+/*
+ * The size and the validators of a file, derived from its inode, size and
+ * mtime. Encoded contents get an ETag of their own.
+ */
+void guava_file_set_stat(guava_file_t *file, const uv_stat_t *st) {
+  file->size = (size_t)st->st_size;
+  file->ino = st->st_ino;
+  file->mtime = st->st_mtim;
+  snprintf(file->etag, sizeof(file->etag), "\"%llx-%llx-%llx%s%s\"",
+           (unsigned long long)file->ino,
+           (unsigned long long)file->size,
+           (unsigned long long)file->mtime.tv_sec,
+           file->encoding ? "-" : "",
+           file->encoding ? file->encoding : "");
+
+  time_t mtime = (time_t)file->mtime.tv_sec;
+  struct tm tm;
+  gmtime_r(&mtime, &tm);
+  strftime(file->last_modified, sizeof(file->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+static void guava_file_watch_on_close(uv_handle_t *handle) {
+  guava_file_watch_t *watch = container_of((uv_fs_event_t *)handle, guava_file_watch_t, handle);
+  guava_string_free(watch->dir);
+  guava_free(watch);
+}
+
+static void guava_file_watch_on_event(uv_fs_event_t *handle, const char *filename, int events, int status) {
+  guava_file_watch_t *watch = container_of(handle, guava_file_watch_t, handle);
+  size_t dir_len = guava_string_len(watch->dir);
+
+  if (status < 0 || !filename) {
+    guava_file_cache_invalidate(watch->cache, watch->dir, dir_len);
+    return;
+  }
+
+  /*
+   * The directory itself was moved or removed, it is reported by its own name.
+   * The watch follows the old directory, everything cached below the path goes.
+   */
+  const char *base = strrchr(watch->dir, '/');
+  base = base ? base + 1 : watch->dir;
+  if ((events & UV_RENAME) && strcmp(filename, base) == 0) {
+    guava_file_cache_invalidate(watch->cache, watch->dir, dir_len);
+    return;
+  }
+
+  char path[MAXPATH];
+  int n = snprintf(path, sizeof(path), "%s/%s", watch->dir, filename);
+  if (n < 0 || (size_t)n >= sizeof(path)) {
+    guava_file_cache_invalidate(watch->cache, watch->dir, dir_len);
+    return;
+  }
+
+  guava_file_cache_invalidate(watch->cache, path, (size_t)n);
+
+  /* A precompressed sibling came or went, the variants of its file are stale */
+  if (n > 3 && (strcmp(path + n - 3, ".gz") == 0 || strcmp(path + n - 3, ".br") == 0)) {
+    guava_file_cache_invalidate(watch->cache, path, (size_t)n - 3);
+  }
+}
+
+static guava_file_watch_t *guava_file_watch_get(guava_file_cache_t *cache, const char *path) {
+  const char *slash = strrchr(path, '/');
+  size_t dir_len = slash ? (size_t)(slash - path) : 1;
+  const char *dir = slash ? path : ".";
+
+  for (guava_file_watch_t *watch = cache->watches; watch; watch = watch->next) {
+    if (guava_string_len(watch->dir) == dir_len && memcmp(watch->dir, dir, dir_len) == 0) {
+      return watch;
+    }
+  }
+
+  guava_file_watch_t *watch = (guava_file_watch_t *)guava_calloc(1, sizeof(guava_file_watch_t));
+  if (!watch) {
+    return NULL;
+  }
+
+  watch->cache = cache;
+  watch->dir = guava_string_new_size(dir, dir_len);
+
+  uv_fs_event_init(cache->loop, &watch->handle);
+  if (uv_fs_event_start(&watch->handle, guava_file_watch_on_event, watch->dir, 0) < 0) {
+    /* Nothing tells us when the files here change, they are not cached */
+    uv_close((uv_handle_t *)&watch->handle, guava_file_watch_on_close);
+    return NULL;
+  }
+
+  /* The watch alone must not keep the loop running */
+  uv_unref((uv_handle_t *)&watch->handle);
+
+  watch->next = cache->watches;
+  cache->watches = watch;
+  return watch;
+}
+
+static void guava_file_watch_put(guava_file_cache_t *cache, guava_file_watch_t *watch) {
+  if (--watch->nfiles > 0) {
+    return;
+  }
+
+  guava_file_watch_t **p = &cache->watches;
+  while (*p != watch) {
+    p = &(*p)->next;
+  }
+  *p = watch->next;
+
+  uv_fs_event_stop(&watch->handle);
+  uv_close((uv_handle_t *)&watch->handle, guava_file_watch_on_close);
+}
+
+static void guava_file_cache_unlink(guava_file_cache_t *cache, guava_file_t *file) {
+  if (file->prev) {
+    file->prev->next = file->next;
+  } else {
+    cache->head = file->next;
+  }
+
+  if (file->next) {
+    file->next->prev = file->prev;
+  } else {
+    cache->tail = file->prev;
+  }
+
+  file->prev = file->next = NULL;
+}
+
+static void guava_file_cache_push_front(guava_file_cache_t *cache, guava_file_t *file) {
+  file->prev = NULL;
+  file->next = cache->head;
+  if (cache->head) {
+    cache->head->prev = file;
+  } else {
+    cache->tail = file;
+  }
+  cache->head = file;
+}
+
+static void guava_file_cache_memory_unlink(guava_file_cache_t *cache, guava_file_t *file) {
+  if (file->mprev) {
+    file->mprev->mnext = file->mnext;
+  } else {
+    cache->mhead = file->mnext;
+  }
+
+  if (file->mnext) {
+    file->mnext->mprev = file->mprev;
+  } else {
+    cache->mtail = file->mprev;
+  }
+
+  file->mprev = file->mnext = NULL;
+}
+
+static void guava_file_cache_memory_push_front(guava_file_cache_t *cache, guava_file_t *file) {
+  file->mprev = NULL;
+  file->mnext = cache->mhead;
+  if (cache->mhead) {
+    cache->mhead->mprev = file;
+  } else {
+    cache->mtail = file;
+  }
+  cache->mhead = file;
+}
+
+/* Drops the cache's reference, responses still sending the file keep it open */
+static void guava_file_cache_remove(guava_file_cache_t *cache, guava_file_t *file) {
+  guava_file_t **p = &cache->buckets[file->hash & (cache->nbuckets - 1)];
+  while (*p != file) {
+    p = &(*p)->hnext;
+  }
+  *p = file->hnext;
+  file->hnext = NULL;
+
+  guava_file_cache_unlink(cache, file);
+  --cache->count;
+
+  if (file->data) {
+    guava_file_cache_memory_unlink(cache, file);
+    cache->memory_used -= file->size;
+    --cache->memory_count;
+  }
+
+  guava_file_watch_put(cache, file->watch);
+  file->watch = NULL;
+
+  guava_file_release(file);
+}
+
+void guava_file_cache_clear(guava_file_cache_t *cache) {
+  while (cache->head) {
+    guava_file_cache_remove(cache, cache->head);
+  }
+}
+
+void guava_file_cache_close(guava_file_cache_t *cache) {
+  guava_file_cache_clear(cache);
+  guava_free(cache->buckets);
+  cache->buckets = NULL;
+  cache->capacity = 0;
+}
+
+guava_file_t *guava_file_cache_get(guava_file_cache_t *cache, const char *path) {
+  if (cache->capacity == 0) {
+    return NULL;
+  }
+
+  size_t len = strlen(path);
+  uint32_t hash = guava_file_cache_hash(path, len);
+  guava_file_t *file = cache->buckets[hash & (cache->nbuckets - 1)];
+
+  for (; file; file = file->hnext) {
+    if (file->hash == hash && guava_string_len(file->path) == len && memcmp(file->path, path, len) == 0) {
+      break;
+    }
+  }
+
+  if (!file) {
+    ++cache->misses;
+    return NULL;
+  }
+
+  /* Changes above the watched directory go unnoticed, so nothing is trusted for long */
+  if (uv_now(cache->loop) >= file->expires) {
+    guava_file_cache_remove(cache, file);
+    ++cache->invalidations;
+    ++cache->misses;
+    return NULL;
+  }
+
+  ++cache->hits;
+  if (file != cache->head) {
+    guava_file_cache_unlink(cache, file);
+    guava_file_cache_push_front(cache, file);
+  }
+  if (file->data && file != cache->mhead) {
+    guava_file_cache_memory_unlink(cache, file);
+    guava_file_cache_memory_push_front(cache, file);
+  }
+
+  guava_file_retain(file);
+  return file;
+}
+
+static void guava_file_cache_evict(guava_file_cache_t *cache, guava_file_t *file) {
+  guava_file_cache_remove(cache, file);
+  ++cache->evictions;
+}
+
+/*
+ * Wraps a freshly opened fd, the caller gets a reference on it. The file is
+ * only cached when its directory can be watched, otherwise the fd is closed
+ * as soon as the caller releases it. data, if any, holds the whole contents
+ * and is taken over too, the fd is not needed anymore then. data which is
+ * not what the fd reads, gzipped contents, has to fit the memory budget.
+ */
+guava_file_t *guava_file_cache_put(guava_file_cache_t *cache,
+                                   const char *path,
+                                   uv_file fd,
+                                   const uv_stat_t *st,
+                                   const char *mime_type,
+                                   const char *encoding,
+                                   char *data) {
+  guava_file_t *file = (guava_file_t *)guava_calloc(1, sizeof(guava_file_t));
+  if (!file) {
+    guava_file_close_async(cache->loop, fd);
+    guava_free(data);
+    return NULL;
+  }
+
+  /* A file bigger than the whole budget would only flush the cache */
+  if (data && (cache->capacity == 0 || (size_t)st->st_size > cache->memory_budget)) {
+    guava_free(data);
+    data = NULL;
+  }
+
+  if (data) {
+    guava_file_close_async(cache->loop, fd);
+    fd = -1;
+  }
+
+  size_t len = strlen(path);
+
+  file->cache = cache;
+  file->hash = guava_file_cache_hash(path, len);
+  file->path = guava_string_new_size(path, len);
+  file->fd = fd;
+  file->data = data;
+  file->encoding = encoding;
+  guava_file_set_stat(file, st);
+  file->mime_type = mime_type;
+  file->refcnt = 1;
+  file->expires = uv_now(cache->loop) + GUAVA_FILE_CACHE_VALID * 1000;
+
+  guava_strbuf_t headers;
+  guava_strbuf_init(&headers);
+  guava_strbuf_append_raw(&headers, "Content-Type: ");
+  guava_strbuf_append_raw(&headers, mime_type);
+  guava_strbuf_append_raw(&headers, "\r\nContent-Length: ");
+  guava_strbuf_append_uint(&headers, file->size);
+  guava_strbuf_append_raw(&headers, "\r\nAccept-Ranges: bytes\r\nETag: ");
+  guava_strbuf_append_raw(&headers, file->etag);
+  guava_strbuf_append_raw(&headers, "\r\nLast-Modified: ");
+  guava_strbuf_append_raw(&headers, file->last_modified);
+  guava_strbuf_append(&headers, "\r\n", 2);
+  if (encoding) {
+    guava_strbuf_append_raw(&headers, "Content-Encoding: ");
+    guava_strbuf_append_raw(&headers, encoding);
+    guava_strbuf_append(&headers, "\r\n", 2);
+  }
+  file->headers = guava_strbuf_to_string(&headers);
+
+  if (cache->capacity == 0) {
+    return file;
+  }
+
+  file->watch = guava_file_watch_get(cache, path);
+  if (!file->watch) {
+    return file;
+  }
+  ++file->watch->nfiles;
+
+  /* Two misses on the same file raced, the newer one wins */
+  guava_file_t *old = cache->buckets[file->hash & (cache->nbuckets - 1)];
+  for (; old; old = old->hnext) {
+    if (old->hash == file->hash && guava_string_len(old->path) == len && memcmp(old->path, path, len) == 0) {
+      guava_file_cache_remove(cache, old);
+      break;
+    }
+  }
+
+  if (cache->count >= cache->capacity) {
+    guava_file_cache_evict(cache, cache->tail);
+  }
+
+  /* Only the files in memory free any of the budget, the ones sent from an fd stay */
+  if (file->data) {
+    while (cache->mtail && cache->memory_used + file->size > cache->memory_budget) {
+      guava_file_cache_evict(cache, cache->mtail);
+    }
+    guava_file_cache_memory_push_front(cache, file);
+    cache->memory_used += file->size;
+    ++cache->memory_count;
+  }
+
+  size_t slot = file->hash & (cache->nbuckets - 1);
+  file->hnext = cache->buckets[slot];
+  cache->buckets[slot] = file;
+
+  guava_file_cache_push_front(cache, file);
+  ++cache->count;
+
+  guava_file_retain(file);
+  return file;
+}
+
+/*
+ * Drops the cached file at path, its encoded variants and the files below it
+ * if path is a directory
+ */
+void guava_file_cache_invalidate(guava_file_cache_t *cache, const char *path, size_t len) {
+  guava_file_t *file = cache->head;
+
+  while (file) {
+    guava_file_t *next = file->next;
+
+    if (guava_string_len(file->path) >= len &&
+        memcmp(file->path, path, len) == 0 &&
+        (file->path[len] == '\0' || file->path[len] == '/' || file->path[len] == GUAVA_FILE_VARIANT_SEP)) {
+      guava_file_cache_remove(cache, file);
+      ++cache->invalidations;
+    }
+
+    file = next;
+  }
+}
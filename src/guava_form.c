@@ -0,0 +1,146 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_form.h"
+#include "guava_strbuf.h"
+
+enum {
+  GUAVA_FORM_NAME = 0,
+  GUAVA_FORM_VALUE
+};
+
+void guava_form_parser_init(guava_form_parser_t *parser) {
+  parser->state = GUAVA_FORM_NAME;
+  parser->escape = 0;
+  parser->hex = 0;
+  guava_strbuf_init(&parser->name);
+  guava_strbuf_init(&parser->value);
+}
+
+void guava_form_parser_deinit(guava_form_parser_t *parser) {
+  guava_strbuf_deinit(&parser->name);
+  guava_strbuf_deinit(&parser->value);
+
+  guava_form_parser_init(parser);
+}
+
+static int guava_form_hex(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static void guava_form_append(guava_form_parser_t *parser, const char *s, size_t len) {
+  if (!len) {
+    return;
+  }
+
+  if (parser->state == GUAVA_FORM_NAME) {
+    guava_strbuf_append(&parser->name, s, len);
+  } else {
+    guava_strbuf_append(&parser->value, s, len);
+  }
+}
+
+/* An escape which turned out not to be one is kept as it is */
+static void guava_form_flush_escape(guava_form_parser_t *parser) {
+  if (parser->escape) {
+    guava_form_append(parser, "%", 1);
+  }
+  if (parser->escape == 2) {
+    guava_form_append(parser, &parser->hex, 1);
+  }
+  parser->escape = 0;
+}
+
+static void guava_form_emit(guava_form_parser_t *parser, PyObject *dict) {
+  if (parser->state == GUAVA_FORM_VALUE && parser->name.len) {
+    PyObject *key = PyString_FromStringAndSize(parser->name.data, parser->name.len);
+    PyObject *value = PyString_FromStringAndSize(parser->value.data ? parser->value.data : "", parser->value.len);
+    if (key && value) {
+      PyDict_SetItem(dict, key, value);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+  }
+
+  /* The buffers are reused by the next pair */
+  parser->state = GUAVA_FORM_NAME;
+  parser->escape = 0;
+  guava_strbuf_clear(&parser->name);
+  guava_strbuf_clear(&parser->value);
+}
+
+void guava_form_parser_execute(guava_form_parser_t *parser, const char *buf, size_t len, PyObject *dict) {
+  size_t start = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    char c = buf[i];
+
+    if (parser->escape) {
+      int d = guava_form_hex(c);
+      if (d >= 0 && parser->escape == 1) {
+        parser->hex = c;
+        parser->escape = 2;
+        start = i + 1;
+        continue;
+      }
+      if (d >= 0) {
+        char decoded = (char)((guava_form_hex(parser->hex) << 4) | d);
+        parser->escape = 0;
+        guava_form_append(parser, &decoded, 1);
+        start = i + 1;
+        continue;
+      }
+      guava_form_flush_escape(parser);
+      start = i;
+    }
+
+    switch (c) {
+    case '%':
+      guava_form_append(parser, buf + start, i - start);
+      parser->escape = 1;
+      start = i + 1;
+      break;
+    case '+':
+      guava_form_append(parser, buf + start, i - start);
+      guava_form_append(parser, " ", 1);
+      start = i + 1;
+      break;
+    case '=':
+      if (parser->state == GUAVA_FORM_NAME) {
+        guava_form_append(parser, buf + start, i - start);
+        parser->state = GUAVA_FORM_VALUE;
+        start = i + 1;
+      }
+      break;
+    case '&':
+      guava_form_append(parser, buf + start, i - start);
+      guava_form_emit(parser, dict);
+      start = i + 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (!parser->escape) {
+    guava_form_append(parser, buf + start, len - start);
+  }
+}
+
+void guava_form_parser_finish(guava_form_parser_t *parser, PyObject *dict) {
+  guava_form_flush_escape(parser);
+  guava_form_emit(parser, dict);
+  guava_form_parser_deinit(parser);
+}
@@ -45,18 +45,22 @@ void guava_handler_deinit(guava_handler_t *handler) {
 
   if (handler->package) {
     guava_string_free(handler->package);
+    handler->package = NULL;
   }
 
   if (handler->module) {
     guava_string_free(handler->module);
+    handler->module = NULL;
   }
 
   if (handler->cls) {
     guava_string_free(handler->cls);
+    handler->cls = NULL;
   }
 
   if (handler->action) {
     guava_string_free(handler->action);
+    handler->action = NULL;
   }
 
   if (handler->args) {
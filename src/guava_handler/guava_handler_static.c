@@ -7,84 +7,969 @@
 #include "guava_handler.h"
 #include "guava_response.h"
 #include "guava_string.h"
+#include "guava_strbuf.h"
+#include "guava_conn.h"
+#include "guava_request.h"
+#include "guava_header.h"
 #include "guava_router/guava_router.h"
 #include "guava_mime_type.h"
+#include "guava_file_cache.h"
 #include "guava_session/guava_session.h"
 #include "guava_memory.h"
 
-#if defined(__APPLE__)
-extern int uv___stream_fd(const uv_stream_t* handle);
-#else
-#define uv___stream_fd(handle) ((handle)->io_watcher.fd)
-#endif
+#include <zlib.h>
 
-#define GUAVA_LIBUV_GET_STREAM_FD uv___stream_fd
+#define GUAVA_HANDLER_STATIC_GZIP 0x01
+#define GUAVA_HANDLER_STATIC_BR   0x02
 
-void guava_handler_static(guava_router_t *router,
-                          guava_conn_t *conn,
-                          guava_request_t *req,
-                          guava_response_t *resp,
-                          uv_write_cb on_write,
-                          uv_fs_cb on_sendfile) {
+/* The request headers the answer depends on, NULL for the missing ones */
+typedef struct {
+  const char *range;
+  const char *if_range;
+  const char *if_none_match;
+  const char *if_modified_since;
+  size_t      range_len;
+  size_t      if_range_len;
+  size_t      if_none_match_len;
+  size_t      if_modified_since_len;
+} guava_handler_static_request_t;
+
+/*
+ * One static request on its way through the libuv threadpool,
+ * stat -> stat the .br/.gz siblings the client accepts -> open (or readdir)
+ * -> read if the file is small or gets gzipped -> gzip -> the conn sends
+ * the file, which stays open or in memory in the server's file cache
+ */
+typedef struct {
+  uv_fs_t           req;
+  uv_work_t         work;
+  guava_conn_t     *conn;
+  guava_response_t *resp;
+  guava_string_t    path;        /* request path, the directory listing links are built from it */
+  guava_bool_t      allow_index;
+  guava_bool_t      vary;
+  guava_bool_t      gzip;
+  guava_bool_t      compress;    /* the file read is gzipped before it is cached */
+  uint8_t           accepted;    /* encodings the client accepts and the mount serves */
+  uint8_t           siblings;    /* encodings whose sibling is still to be looked for */
+  const char       *encoding;    /* of the file opened, NULL for identity */
+  size_t            memory_file_size;
+  guava_string_t    cache_control;
+  uv_stat_t         st;
+  uv_stat_t         identity_st; /* of the file itself while a sibling is being opened */
+  uv_file           fd;
+  char             *data;
+  char             *compressed;
+  size_t            compressed_len;
+  guava_handler_static_request_t request;
+  char             *request_data; /* copy of the header values request points to */
+  char              filename[MAXPATH];
+  char              key[MAXPATH + 2];     /* filename plus the accepted encodings */
+  char              variant[MAXPATH + 3]; /* filename plus the sibling's extension, empty once the file itself is opened */
+} guava_handler_static_t;
 
-  char *req_filename = strstr(req->path, "/");
+typedef struct {
+  int64_t first;
+  int64_t last;
+} guava_handler_static_range_t;
 
-  char filename[MAXPATH];
-  snprintf(filename, sizeof(filename), "%s/%s", ".", req_filename);
-  uv_fs_t stat_req;
-  uv_fs_stat(&conn->server->loop, &stat_req, filename, NULL);
+static void guava_handler_static_on_stat(uv_fs_t *req);
+
+static void guava_handler_static_next_variant(guava_handler_static_t *s);
+
+static void guava_handler_static_on_open(uv_fs_t *req);
+
+static void guava_handler_static_on_read(uv_fs_t *req);
+
+static void guava_handler_static_on_variant_stat(uv_fs_t *req);
+
+static void guava_handler_static_on_readdir(uv_fs_t *req);
+
+static guava_bool_t guava_handler_static_path_is_safe(const char *path) {
+  const char *p = path;
+
+  while (*p) {
+    while (*p == '/') {
+      ++p;
+    }
+
+    const char *q = p;
+    while (*q && *q != '/') {
+      ++q;
+    }
+
+    if (q - p == 2 && p[0] == '.' && p[1] == '.') {
+      return GUAVA_FALSE;
+    }
+
+    p = q;
+  }
+
+  return GUAVA_TRUE;
+}
+
+static void guava_handler_static_free(guava_handler_static_t *s) {
+  guava_string_free(s->path);
+  if (s->cache_control) {
+    guava_string_free(s->cache_control);
+  }
+  guava_free(s->request_data);
+  guava_free(s->data);
+  guava_free(s->compressed);
+  guava_free(s);
+}
+
+/* Returns GUAVA_TRUE if the conn went away meanwhile, s is freed then */
+static guava_bool_t guava_handler_static_abandoned(guava_handler_static_t *s) {
+  guava_conn_t *conn = s->conn;
+
+  if (!conn->closed) {
+    return GUAVA_FALSE;
+  }
+
+  guava_response_unpark(s->resp);
+  guava_handler_static_free(s);
+  guava_conn_release(conn);
+  return GUAVA_TRUE;
+}
+
+static void guava_handler_static_finish(guava_handler_static_t *s) {
+  guava_response_resume(s->resp);
+  guava_handler_static_free(s);
+}
 
-  uv_fs_req_cleanup(&stat_req);
+static const char *guava_handler_static_skip_spaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+static const char *guava_handler_static_parse_offset(const char *p, const char *end, int64_t *value) {
+  const char *start = p;
+  int64_t v = 0;
+
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (v > (INT64_MAX - 9) / 10) {
+      return NULL;
+    }
+    v = v * 10 + (*p++ - '0');
+  }
+
+  *value = v;
+  return p > start ? p : NULL;
+}
+
+/*
+ * Parses a "bytes=" Range header against a file of size bytes, the
+ * satisfiable ranges end up in ranges. Returns -1 if the header is to be
+ * ignored and the whole file sent, otherwise the number of ranges, 0 if
+ * none of them can be satisfied.
+ */
+static int guava_handler_static_parse_ranges(const char *spec,
+                                             size_t len,
+                                             size_t size,
+                                             guava_handler_static_range_t *ranges) {
+  const char *p = spec;
+  const char *end = spec + len;
+  int n = 0;
+  int total = 0;
+
+  if (len < 6 || strncasecmp(p, "bytes=", 6) != 0) {
+    return -1;
+  }
+  p += 6;
+
+  for (;;) {
+    int64_t first = -1;
+    int64_t last = -1;
+
+    p = guava_handler_static_skip_spaces(p, end);
+
+    if (p < end && *p == '-') {
+      /* The last n bytes */
+      int64_t suffix = 0;
+      p = guava_handler_static_parse_offset(p + 1, end, &suffix);
+      if (!p) {
+        return -1;
+      }
+      if (suffix > 0 && size > 0) {
+        first = (size_t)suffix >= size ? 0 : (int64_t)size - suffix;
+        last = (int64_t)size - 1;
+      }
+    } else {
+      p = guava_handler_static_parse_offset(p, end, &first);
+      if (!p || p >= end || *p != '-') {
+        return -1;
+      }
+      ++p;
+
+      if (p < end && *p >= '0' && *p <= '9') {
+        p = guava_handler_static_parse_offset(p, end, &last);
+        if (!p || last < first) {
+          return -1;
+        }
+      } else {
+        last = INT64_MAX;
+      }
+
+      if ((size_t)first >= size) {
+        first = -1;
+      } else if ((size_t)last >= size) {
+        last = (int64_t)size - 1;
+      }
+    }
 
-  do {
-    if (stat_req.result != 0) {
-      guava_response_404(resp, NULL);
-      guava_response_send(resp, on_write);
+    if (++total > GUAVA_HANDLER_STATIC_MAX_RANGES) {
+      return -1;
+    }
+
+    if (first >= 0) {
+      ranges[n].first = first;
+      ranges[n].last = last;
+      ++n;
+    }
+
+    p = guava_handler_static_skip_spaces(p, end);
+    if (p == end) {
       break;
     }
+    if (*p != ',') {
+      return -1;
+    }
+    ++p;
+  }
 
-    uv_stat_t *s = &stat_req.statbuf;
-    guava_response_set_status_code(resp, 200);
+  return n;
+}
 
-    if (S_ISDIR(s->st_mode)) {
-      guava_response_set_header(resp, "Content-Type", "text/html");
-      guava_string_t data = guava_string_new("");
-
-      uv_fs_t readdir_req;
-      readdir_req.data = resp;
-      uv_fs_readdir(&conn->server->loop, &readdir_req, filename, 0, NULL);
-
-      const char *ptr = readdir_req.ptr;
-      size_t idx = 0;
-      while (idx < readdir_req.result) {
-        data = guava_string_append_raw(data, "<a href=\"");
-        data = guava_string_append(data, req->path);
-        if (req->path[guava_string_len(req->path)-1] != '/') {
-          data = guava_string_append_raw(data, "/");
+/* If-Range holds either the strong ETag or the Last-Modified date the client has */
+static guava_bool_t guava_handler_static_if_range_matches(guava_file_t *file, const char *value, size_t len) {
+  const char *validator = len > 0 && value[0] == '"' ? file->etag : file->last_modified;
+  return strlen(validator) == len && memcmp(validator, value, len) == 0;
+}
+
+static void guava_handler_static_append_content_range(guava_strbuf_t *buf, int64_t first, int64_t last, size_t size) {
+  guava_strbuf_append_raw(buf, "bytes ");
+  guava_strbuf_append_uint(buf, (uint64_t)first);
+  guava_strbuf_append_char(buf, '-');
+  guava_strbuf_append_uint(buf, (uint64_t)last);
+  guava_strbuf_append_char(buf, '/');
+  guava_strbuf_append_uint(buf, size);
+}
+
+static void guava_handler_static_set_ranges(guava_response_t *resp,
+                                            guava_file_t *file,
+                                            const guava_handler_static_range_t *ranges,
+                                            int n) {
+  static uint32_t boundary_seq = 0;
+  guava_strbuf_t buf;
+
+  guava_strbuf_init(&buf);
+  guava_response_clear_data(resp);
+  guava_response_hold_file(resp, file);
+  guava_response_set_status_code(resp, 206);
+  guava_headers_set_static(&resp->headers, GUAVA_HEADER_ETAG, file->etag);
+  guava_headers_set_static(&resp->headers, GUAVA_HEADER_LAST_MODIFIED, file->last_modified);
+  if (file->encoding) {
+    guava_headers_set_static(&resp->headers, GUAVA_HEADER_CONTENT_ENCODING, file->encoding);
+  }
+
+  if (n == 1) {
+    guava_handler_static_append_content_range(&buf, ranges[0].first, ranges[0].last, file->size);
+    guava_response_set_header(resp, "Content-Type", file->mime_type);
+    guava_response_set_header(resp, "Content-Range", buf.data);
+    guava_response_write_file(resp, ranges[0].first, (size_t)(ranges[0].last - ranges[0].first + 1));
+    guava_strbuf_deinit(&buf);
+    return;
+  }
+
+  char boundary[32];
+  snprintf(boundary, sizeof(boundary), "%08x%08x", file->hash, ++boundary_seq);
+
+  guava_strbuf_append_raw(&buf, "multipart/byteranges; boundary=");
+  guava_strbuf_append_raw(&buf, boundary);
+  guava_response_set_header(resp, "Content-Type", buf.data);
+
+  for (int i = 0; i < n; ++i) {
+    guava_strbuf_clear(&buf);
+    guava_strbuf_append_raw(&buf, i == 0 ? "--" : "\r\n--");
+    guava_strbuf_append_raw(&buf, boundary);
+    guava_strbuf_append_raw(&buf, "\r\nContent-Type: ");
+    guava_strbuf_append_raw(&buf, file->mime_type);
+    guava_strbuf_append_raw(&buf, "\r\nContent-Range: ");
+    guava_handler_static_append_content_range(&buf, ranges[i].first, ranges[i].last, file->size);
+    guava_strbuf_append_raw(&buf, "\r\n\r\n");
+    guava_response_write_data_size(resp, buf.data, buf.len);
+    guava_response_write_file(resp, ranges[i].first, (size_t)(ranges[i].last - ranges[i].first + 1));
+  }
+
+  guava_strbuf_clear(&buf);
+  guava_strbuf_append_raw(&buf, "\r\n--");
+  guava_strbuf_append_raw(&buf, boundary);
+  guava_strbuf_append_raw(&buf, "--\r\n");
+  guava_response_write_data_size(resp, buf.data, buf.len);
+
+  guava_strbuf_deinit(&buf);
+}
+
+/* The encodings of GUAVA_HANDLER_STATIC_GZIP and _BR an Accept-Encoding allows, q=0 rules one out */
+static uint8_t guava_handler_static_accepted_encodings(const char *value, size_t len) {
+  const char *p = value;
+  const char *end = value + len;
+  uint8_t encodings = 0;
+
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+      ++p;
+    }
+
+    const char *name = p;
+    while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+      ++p;
+    }
+    size_t name_len = (size_t)(p - name);
+
+    const char *params = p;
+    while (p < end && *p != ',') {
+      ++p;
+    }
+
+    guava_bool_t rejected = GUAVA_FALSE;
+    for (const char *q = params; q + 2 < p; ++q) {
+      if ((q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+        q += 2;
+        rejected = GUAVA_TRUE;
+        for (; q < p && *q != ' ' && *q != '\t' && *q != ';'; ++q) {
+          if (*q >= '1' && *q <= '9') {
+            rejected = GUAVA_FALSE;
+          }
         }
-        data = guava_string_append_raw(data, ptr);
-        data = guava_string_append_raw(data, "\">");
-        data = guava_string_append_raw(data, ptr);
-        data = guava_string_append_raw(data, "</a><br />");
-        ptr += strlen(ptr) + 1;
-        ++idx;
+        break;
       }
-      guava_response_set_data(resp, data);
-      uv_fs_req_cleanup(&readdir_req);
-    } else {
-      guava_response_set_header(resp, "Content-Type", guava_mime_type_guess(filename));
-      char buf[1024];
-      snprintf(buf, sizeof(buf), "%zd", s->st_size);
-      guava_response_set_header(resp, "Content-Length", buf);
     }
 
-    guava_response_send(resp, on_write);
+    if (rejected) {
+      continue;
+    }
 
-    if (!S_ISDIR(s->st_mode)) {
-      uv_fs_t open_req;
-      int fd = uv_fs_open(&conn->server->loop, &open_req, filename, O_RDONLY, 0, NULL);
-      uv_fs_t *write_req = (uv_fs_t *)guava_malloc(sizeof(*write_req));
-      uv_fs_sendfile(&conn->server->loop, write_req, GUAVA_LIBUV_GET_STREAM_FD((uv_stream_t *)&conn->stream), fd, 0, (size_t)s->st_size, on_sendfile);
+    if (name_len == 4 && strncasecmp(name, "gzip", 4) == 0) {
+      encodings |= GUAVA_HANDLER_STATIC_GZIP;
+    } else if (name_len == 2 && strncasecmp(name, "br", 2) == 0) {
+      encodings |= GUAVA_HANDLER_STATIC_BR;
     }
-  } while(0);
+  }
+
+  return encodings;
+}
+
+static void guava_handler_static_request_init(guava_handler_static_request_t *request, guava_request_t *req) {
+  request->range = guava_request_get_header(req, "Range", &request->range_len);
+  request->if_range = NULL;
+  if (request->range) {
+    request->if_range = guava_request_get_header(req, "If-Range", &request->if_range_len);
+  }
+  request->if_none_match = guava_request_get_header(req, "If-None-Match", &request->if_none_match_len);
+  request->if_modified_since = guava_request_get_header(req, "If-Modified-Since", &request->if_modified_since_len);
+}
+
+/* The request is gone once the handler returns, the values it points to are copied into s */
+static guava_bool_t guava_handler_static_request_copy(guava_handler_static_t *s,
+                                                      const guava_handler_static_request_t *request) {
+  const char **values[4] = {&s->request.range, &s->request.if_range,
+                            &s->request.if_none_match, &s->request.if_modified_since};
+  size_t *lens[4] = {&s->request.range_len, &s->request.if_range_len,
+                     &s->request.if_none_match_len, &s->request.if_modified_since_len};
+  size_t total = 0;
+
+  s->request = *request;
+  s->request_data = NULL;
+
+  for (int i = 0; i < 4; ++i) {
+    total += *values[i] ? *lens[i] : 0;
+  }
+
+  if (total == 0) {
+    return GUAVA_TRUE;
+  }
+
+  char *p = s->request_data = (char *)guava_malloc(total);
+  if (!p) {
+    return GUAVA_FALSE;
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    if (*values[i]) {
+      memcpy(p, *values[i], *lens[i]);
+      *values[i] = p;
+      p += *lens[i];
+    }
+  }
+
+  return GUAVA_TRUE;
+}
+
+/* If-None-Match holds a list of entity tags or "*", they are compared weakly */
+static guava_bool_t guava_handler_static_etag_matches(const char *etag, const char *list, size_t len) {
+  const char *p = list;
+  const char *end = list + len;
+  size_t etag_len = strlen(etag);
+
+  while (p < end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+      ++p;
+    }
+    if (p == end) {
+      break;
+    }
+
+    if (*p == '*') {
+      return GUAVA_TRUE;
+    }
+
+    if (end - p > 2 && p[0] == 'W' && p[1] == '/') {
+      p += 2;
+    }
+
+    if (*p != '"') {
+      return GUAVA_FALSE;
+    }
+
+    const char *q = memchr(p + 1, '"', (size_t)(end - p - 1));
+    if (!q) {
+      return GUAVA_FALSE;
+    }
+    ++q;
+
+    if ((size_t)(q - p) == etag_len && memcmp(p, etag, etag_len) == 0) {
+      return GUAVA_TRUE;
+    }
+
+    p = q;
+  }
+
+  return GUAVA_FALSE;
+}
+
+static guava_bool_t guava_handler_static_unmodified_since(guava_file_t *file, const char *value, size_t len) {
+  char date[64];
+  struct tm tm;
+
+  /* Clients mostly send back the Last-Modified they got */
+  if (strlen(file->last_modified) == len && memcmp(file->last_modified, value, len) == 0) {
+    return GUAVA_TRUE;
+  }
+
+  if (len >= sizeof(date)) {
+    return GUAVA_FALSE;
+  }
+  memcpy(date, value, len);
+  date[len] = '\0';
+
+  memset(&tm, 0, sizeof(tm));
+  if (!strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm)) {
+    return GUAVA_FALSE;
+  }
+
+  return (time_t)file->mtime.tv_sec <= timegm(&tm);
+}
+
+/* If-Modified-Since only counts when there is no If-None-Match */
+static guava_bool_t guava_handler_static_not_modified(guava_file_t *file, const guava_handler_static_request_t *request) {
+  if (request->if_none_match) {
+    return guava_handler_static_etag_matches(file->etag, request->if_none_match, request->if_none_match_len);
+  }
+
+  if (request->if_modified_since) {
+    return guava_handler_static_unmodified_since(file, request->if_modified_since, request->if_modified_since_len);
+  }
+
+  return GUAVA_FALSE;
+}
+
+static void guava_handler_static_set_cache_control(guava_response_t *resp, guava_string_t cache_control) {
+  if (cache_control) {
+    guava_headers_set_known(&resp->headers, GUAVA_HEADER_CACHE_CONTROL,
+                            cache_control, guava_string_len(cache_control));
+  }
+}
+
+/* Header only, the validators are copied since file may only be a stat result */
+static void guava_handler_static_set_not_modified(guava_response_t *resp,
+                                                  guava_file_t *file,
+                                                  guava_string_t cache_control,
+                                                  guava_bool_t vary) {
+  if (vary) {
+    guava_headers_set_static(&resp->headers, GUAVA_HEADER_VARY, "Accept-Encoding");
+  }
+
+  guava_response_set_status_code(resp, 304);
+  guava_response_clear_data(resp);
+  guava_headers_set_known(&resp->headers, GUAVA_HEADER_ETAG, file->etag, strlen(file->etag));
+  guava_headers_set_known(&resp->headers, GUAVA_HEADER_LAST_MODIFIED,
+                          file->last_modified, strlen(file->last_modified));
+  guava_handler_static_set_cache_control(resp, cache_control);
+}
+
+/*
+ * Answers with the whole file, the ranges asked for or a 304 if the
+ * client's copy is still fresh. The response takes over the reference on file.
+ */
+static void guava_handler_static_set_file(guava_response_t *resp,
+                                          guava_file_t *file,
+                                          const guava_handler_static_request_t *request,
+                                          guava_string_t cache_control,
+                                          guava_bool_t vary) {
+  guava_handler_static_range_t ranges[GUAVA_HANDLER_STATIC_MAX_RANGES];
+  int n = -1;
+
+  if (guava_handler_static_not_modified(file, request)) {
+    guava_handler_static_set_not_modified(resp, file, cache_control, vary);
+    guava_file_release(file);
+    return;
+  }
+
+  /* The mount answers with a representation depending on Accept-Encoding */
+  if (vary) {
+    guava_headers_set_static(&resp->headers, GUAVA_HEADER_VARY, "Accept-Encoding");
+  }
+
+  if (request->range &&
+      (!request->if_range ||
+       guava_handler_static_if_range_matches(file, request->if_range, request->if_range_len))) {
+    n = guava_handler_static_parse_ranges(request->range, request->range_len, file->size, ranges);
+  }
+
+  if (n < 0) {
+    guava_response_set_status_code(resp, 200);
+    guava_handler_static_set_cache_control(resp, cache_control);
+    guava_response_set_cached_file(resp, file);
+    return;
+  }
+
+  if (n == 0) {
+    guava_strbuf_t buf;
+    guava_strbuf_init(&buf);
+    guava_strbuf_append_raw(&buf, "bytes */");
+    guava_strbuf_append_uint(&buf, file->size);
+
+    guava_response_set_status_code(resp, 416);
+    guava_response_set_header(resp, "Content-Range", buf.data);
+    guava_response_clear_data(resp);
+
+    guava_strbuf_deinit(&buf);
+    guava_file_release(file);
+    return;
+  }
+
+  guava_handler_static_set_cache_control(resp, cache_control);
+  guava_handler_static_set_ranges(resp, file, ranges, n);
+}
+
+static void guava_handler_static_404(guava_handler_static_t *s) {
+  guava_response_404(s->resp, NULL);
+  guava_handler_static_finish(s);
+}
+
+static void guava_handler_static_on_stat(uv_fs_t *req) {
+  guava_handler_static_t *s = container_of(req, guava_handler_static_t, req);
+  ssize_t result = req->result;
+  uv_stat_t st = req->statbuf;
+
+  uv_fs_req_cleanup(req);
+  s->st = st;
+
+  if (guava_handler_static_abandoned(s)) {
+    return;
+  }
+
+  if (result != 0) {
+    guava_handler_static_404(s);
+    return;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    if (!s->allow_index ||
+        uv_fs_readdir(&s->conn->server->loop, &s->req, s->filename, 0, guava_handler_static_on_readdir) < 0) {
+      guava_handler_static_404(s);
+    }
+    return;
+  }
+
+  if (!S_ISREG(st.st_mode)) {
+    guava_handler_static_404(s);
+    return;
+  }
+
+  if (s->request.if_none_match || s->request.if_modified_since) {
+    /* The validators come from the stat alone, a revalidation never opens the file */
+    guava_file_t file;
+    memset(&file, 0, sizeof(file));
+    guava_file_set_stat(&file, &st);
+
+    if (guava_handler_static_not_modified(&file, &s->request)) {
+      guava_handler_static_set_not_modified(s->resp, &file, s->cache_control, s->vary);
+      guava_handler_static_finish(s);
+      return;
+    }
+  }
+
+  guava_handler_static_next_variant(s);
+}
+
+/* Looks for the next precompressed sibling, the file itself is opened once none is left */
+static void guava_handler_static_next_variant(guava_handler_static_t *s) {
+  uv_loop_t *loop = &s->conn->server->loop;
+  guava_file_cache_t *files = &s->conn->server->files;
+  const char *ext = NULL;
+
+  if (s->siblings & GUAVA_HANDLER_STATIC_BR) {
+    s->siblings &= ~GUAVA_HANDLER_STATIC_BR;
+    s->encoding = "br";
+    ext = "br";
+  } else if (s->siblings & GUAVA_HANDLER_STATIC_GZIP) {
+    s->siblings &= ~GUAVA_HANDLER_STATIC_GZIP;
+    s->encoding = "gzip";
+    ext = "gz";
+  }
+
+  if (ext) {
+    snprintf(s->variant, sizeof(s->variant), "%s.%s", s->filename, ext);
+    if (uv_fs_stat(loop, &s->req, s->variant, guava_handler_static_on_variant_stat) < 0) {
+      guava_handler_static_next_variant(s);
+    }
+    return;
+  }
+
+  /* Compressed data can only be cached in memory, it has to fit there */
+  size_t size = (size_t)s->st.st_size;
+  s->encoding = NULL;
+  s->variant[0] = '\0';
+  s->compress = s->gzip &&
+                (s->accepted & GUAVA_HANDLER_STATIC_GZIP) &&
+                size > 0 &&
+                size <= GUAVA_ROUTER_STATIC_GZIP_MAX_SIZE &&
+                size <= files->memory_budget &&
+                files->capacity > 0 &&
+                guava_mime_type_compressible(guava_mime_type_guess(s->filename));
+
+  if (uv_fs_open(loop, &s->req, s->filename, O_RDONLY, 0, guava_handler_static_on_open) < 0) {
+    guava_handler_static_404(s);
+  }
+}
+
+/* The sibling is there but can't be opened, unreadable for one, the next one or the file itself is sent */
+static void guava_handler_static_variant_failed(guava_handler_static_t *s) {
+  s->st = s->identity_st;
+  guava_handler_static_next_variant(s);
+}
+
+static void guava_handler_static_on_variant_stat(uv_fs_t *req) {
+  guava_handler_static_t *s = container_of(req, guava_handler_static_t, req);
+  ssize_t result = req->result;
+  uv_stat_t st = req->statbuf;
+
+  uv_fs_req_cleanup(req);
+
+  if (guava_handler_static_abandoned(s)) {
+    return;
+  }
+
+  if (result != 0 || !S_ISREG(st.st_mode)) {
+    guava_handler_static_next_variant(s);
+    return;
+  }
+
+  s->identity_st = s->st;
+  s->st = st;
+  if (uv_fs_open(&s->conn->server->loop, &s->req, s->variant, O_RDONLY, 0, guava_handler_static_on_open) < 0) {
+    guava_handler_static_variant_failed(s);
+  }
+}
+
+static void guava_handler_static_opened(guava_handler_static_t *s) {
+  guava_file_t *file = NULL;
+
+  if (s->fd >= 0) {
+    /* Cached even if the conn went away, the next request for it skips the filesystem */
+    file = guava_file_cache_put(&s->conn->server->files, s->key, s->fd, &s->st,
+                                guava_mime_type_guess(s->filename), s->encoding, s->data);
+    s->data = NULL;
+  }
+
+  if (file) {
+    guava_handler_static_set_file(s->resp, file, &s->request, s->cache_control, s->vary);
+  }
+
+  if (guava_handler_static_abandoned(s)) {
+    return;
+  }
+
+  if (!file) {
+    guava_handler_static_404(s);
+    return;
+  }
+
+  guava_handler_static_finish(s);
+}
+
+static void guava_handler_static_on_open(uv_fs_t *req) {
+  guava_handler_static_t *s = container_of(req, guava_handler_static_t, req);
+  ssize_t fd = req->result;
+
+  uv_fs_req_cleanup(req);
+  s->fd = fd >= 0 ? (uv_file)fd : -1;
+
+  if (s->fd < 0 && s->variant[0]) {
+    if (!guava_handler_static_abandoned(s)) {
+      guava_handler_static_variant_failed(s);
+    }
+    return;
+  }
+
+  /* Small files are read once and answered from memory afterwards, so are gzipped ones */
+  size_t size = (size_t)s->st.st_size;
+  if (s->fd >= 0 && size > 0 && (s->compress || (!s->conn->closed && size <= s->memory_file_size))) {
+    s->data = (char *)guava_malloc(size);
+    if (s->data) {
+      uv_buf_t buf = uv_buf_init(s->data, (unsigned int)size);
+      if (uv_fs_read(&s->conn->server->loop, &s->req, s->fd, &buf, 1, 0, guava_handler_static_on_read) == 0) {
+        return;
+      }
+      guava_free(s->data);
+      s->data = NULL;
+    }
+  }
+
+  s->compress = GUAVA_FALSE;
+  guava_handler_static_opened(s);
+}
+
+static void guava_handler_static_on_gzip(uv_work_t *work) {
+  guava_handler_static_t *s = container_of(work, guava_handler_static_t, work);
+  size_t bound = s->compressed_len;
+  z_stream zs;
+
+  s->compressed_len = 0;
+
+  memset(&zs, 0, sizeof(zs));
+  /* 16 + MAX_WBITS writes a gzip header and trailer instead of the zlib ones */
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+
+  zs.next_in = (Bytef *)s->data;
+  zs.avail_in = (uInt)s->st.st_size;
+  zs.next_out = (Bytef *)s->compressed;
+  zs.avail_out = (uInt)bound;
+
+  if (deflate(&zs, Z_FINISH) == Z_STREAM_END) {
+    s->compressed_len = zs.total_out;
+  }
+
+  deflateEnd(&zs);
+}
+
+static void guava_handler_static_after_gzip(uv_work_t *work, int status) {
+  guava_handler_static_t *s = container_of(work, guava_handler_static_t, work);
+  size_t size = (size_t)s->st.st_size;
+
+  if (status == 0 && s->compressed_len > 0 && s->compressed_len < size) {
+    guava_free(s->data);
+    s->data = s->compressed;
+    s->compressed = NULL;
+    s->st.st_size = (int64_t)s->compressed_len;
+    s->encoding = "gzip";
+  } else if (size > s->memory_file_size) {
+    /* Not worth it, the file is sent as it is */
+    guava_free(s->data);
+    s->data = NULL;
+  }
+
+  guava_handler_static_opened(s);
+}
+
+/* Compressed on the threadpool, the buffers are allocated here since the allocator is not thread safe */
+static void guava_handler_static_gzip(guava_handler_static_t *s) {
+  size_t size = (size_t)s->st.st_size;
+
+  s->compressed_len = compressBound((uLong)size) + 18;
+  s->compressed = (char *)guava_malloc(s->compressed_len);
+
+  if (!s->compressed ||
+      uv_queue_work(&s->conn->server->loop, &s->work, guava_handler_static_on_gzip, guava_handler_static_after_gzip) < 0) {
+    s->compressed_len = 0;
+    guava_handler_static_after_gzip(&s->work, -1);
+  }
+}
+
+static void guava_handler_static_on_read(uv_fs_t *req) {
+  guava_handler_static_t *s = container_of(req, guava_handler_static_t, req);
+  ssize_t result = req->result;
+
+  uv_fs_req_cleanup(req);
+
+  if (result < 0 || (size_t)result != (size_t)s->st.st_size) {
+    /* Changed under us or a short read, sendfile copes with that */
+    guava_free(s->data);
+    s->data = NULL;
+    s->compress = GUAVA_FALSE;
+  }
+
+  if (s->compress) {
+    guava_handler_static_gzip(s);
+    return;
+  }
+
+  guava_handler_static_opened(s);
+}
+
+static void guava_handler_static_on_readdir(uv_fs_t *req) {
+  guava_handler_static_t *s = container_of(req, guava_handler_static_t, req);
+
+  if (guava_handler_static_abandoned(s)) {
+    uv_fs_req_cleanup(req);
+    return;
+  }
+
+  if (req->result < 0) {
+    uv_fs_req_cleanup(req);
+    guava_handler_static_404(s);
+    return;
+  }
+
+  guava_strbuf_t data;
+  guava_strbuf_init(&data);
+  size_t path_len = guava_string_len(s->path);
+
+  const char *ptr = req->ptr;
+  for (ssize_t idx = 0; idx < req->result; ++idx) {
+    guava_strbuf_append_raw(&data, "<a href=\"");
+    guava_strbuf_append(&data, s->path, path_len);
+    if (path_len == 0 || s->path[path_len - 1] != '/') {
+      guava_strbuf_append_char(&data, '/');
+    }
+    guava_strbuf_append_raw(&data, ptr);
+    guava_strbuf_append_raw(&data, "\">");
+    guava_strbuf_append_raw(&data, ptr);
+    guava_strbuf_append_raw(&data, "</a><br />");
+    ptr += strlen(ptr) + 1;
+  }
+
+  uv_fs_req_cleanup(req);
+
+  guava_response_set_status_code(s->resp, 200);
+  guava_response_set_header(s->resp, "Content-Type", "text/html");
+  guava_response_set_data(s->resp, guava_strbuf_to_string(&data));
+
+  guava_handler_static_finish(s);
+}
+
+void guava_handler_static(guava_router_t *router,
+                          guava_conn_t *conn,
+                          guava_request_t *req,
+                          guava_response_t *resp) {
+  guava_router_static_t *static_router = (guava_router_static_t *)router;
+
+  /* The part of the path after the mount point is looked up in the directory */
+  const char *rel = req->path;
+  size_t mount_len = guava_string_len(router->mount_point);
+  if (strncmp(rel, router->mount_point, mount_len) == 0) {
+    rel += mount_len;
+  }
+  while (*rel == '/') {
+    ++rel;
+  }
+
+  if (!guava_handler_static_path_is_safe(rel)) {
+    guava_response_404(resp, NULL);
+    guava_response_send(resp);
+    return;
+  }
+
+  char filename[MAXPATH];
+  int n = snprintf(filename, sizeof(filename), "%s/%s", static_router->directory, rel);
+  if (n < 0 || (size_t)n >= sizeof(filename)) {
+    guava_response_404(resp, NULL);
+    guava_response_send(resp);
+    return;
+  }
+
+  guava_handler_static_request_t request;
+  guava_handler_static_request_init(&request, req);
+
+  /* Each set of accepted encodings has its own cache entry, identity when no variant exists */
+  uint8_t accepted = 0;
+  char key[MAXPATH + 2];
+  guava_bool_t vary = static_router->gzip_static || static_router->gzip;
+
+  memcpy(key, filename, (size_t)n + 1);
+
+  size_t accept_encoding_len = 0;
+  const char *accept_encoding = vary ? guava_request_get_header(req, "Accept-Encoding", &accept_encoding_len) : NULL;
+  if (accept_encoding) {
+    accepted = guava_handler_static_accepted_encodings(accept_encoding, accept_encoding_len);
+    if (!static_router->gzip_static) {
+      accepted &= GUAVA_HANDLER_STATIC_GZIP;
+    }
+  }
+
+  if (accepted) {
+    key[n] = GUAVA_FILE_VARIANT_SEP;
+    key[n + 1] = (char)('0' + accepted);
+    key[n + 2] = '\0';
+  }
+
+  guava_file_t *file = guava_file_cache_get(&conn->server->files, key);
+  if (file) {
+    /* Nothing to ask the filesystem, sendfile is the only syscall left */
+    guava_handler_static_set_file(resp, file, &request, static_router->cache_control, vary);
+    guava_response_send(resp);
+    return;
+  }
+
+  guava_handler_static_t *s = (guava_handler_static_t *)guava_malloc(sizeof(guava_handler_static_t));
+  if (!s) {
+    guava_response_500(resp, NULL);
+    guava_response_send(resp);
+    return;
+  }
+
+  s->conn = conn;
+  s->resp = resp;
+  s->path = guava_string_new_size(req->path, guava_string_len(req->path));
+  s->allow_index = static_router->allow_index;
+  s->memory_file_size = static_router->memory_file_size;
+  s->vary = vary;
+  s->gzip = static_router->gzip;
+  s->compress = GUAVA_FALSE;
+  s->accepted = accepted;
+  s->siblings = static_router->gzip_static ? accepted : 0;
+  s->encoding = NULL;
+  s->variant[0] = '\0';
+  s->fd = -1;
+  s->data = NULL;
+  s->compressed = NULL;
+  s->compressed_len = 0;
+  s->cache_control = NULL;
+  if (static_router->cache_control) {
+    s->cache_control = guava_string_new_size(static_router->cache_control,
+                                             guava_string_len(static_router->cache_control));
+  }
+  memcpy(s->filename, filename, (size_t)n + 1);
+  memcpy(s->key, key, sizeof(key));
+
+  if (!guava_handler_static_request_copy(s, &request)) {
+    guava_handler_static_free(s);
+    guava_response_500(resp, NULL);
+    guava_response_send(resp);
+    return;
+  }
+
+  /* The request is gone once this returns, the response keeps its place in the queue */
+  guava_response_park(resp);
+
+  if (uv_fs_stat(&conn->server->loop, &s->req, s->filename, guava_handler_static_on_stat) < 0) {
+    guava_handler_static_404(s);
+  }
 }
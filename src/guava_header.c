@@ -0,0 +1,214 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_header.h"
+#include "guava_string.h"
+#include "guava_memory.h"
+
+#include <strings.h>
+
+static const char *guava_header_known_names[GUAVA_HEADER_KNOWN_MAX] = {
+  "Server",
+  "Date",
+  "Connection",
+  "Content-Type",
+  "Content-Length",
+  "Content-Encoding",
+  "Content-Range",
+  "Accept-Ranges",
+  "Cache-Control",
+  "ETag",
+  "Last-Modified",
+  "Location",
+  "Set-Cookie",
+  "Vary"
+};
+
+void guava_headers_init(guava_headers_t *headers) {
+  headers->entries = headers->inline_entries;
+  headers->nentries = 0;
+  headers->size = GUAVA_RESPONSE_INLINE_HEADERS;
+  memset(headers->known, 0, sizeof(headers->known));
+}
+
+static void guava_header_free_value(guava_header_t *header) {
+  if (header->flags & GUAVA_HEADER_VALUE_OWNED) {
+    guava_string_free((guava_string_t)header->value);
+  }
+  header->value = NULL;
+  header->value_len = 0;
+  header->flags &= ~GUAVA_HEADER_VALUE_OWNED;
+}
+
+void guava_headers_deinit(guava_headers_t *headers) {
+  for (size_t i = 0; i < headers->nentries; ++i) {
+    guava_header_t *header = &headers->entries[i];
+    guava_header_free_value(header);
+    if (header->flags & GUAVA_HEADER_NAME_OWNED) {
+      guava_string_free((guava_string_t)header->name);
+    }
+  }
+
+  if (headers->entries != headers->inline_entries) {
+    guava_free(headers->entries);
+  }
+
+  guava_headers_init(headers);
+}
+
+int guava_header_known_id(const char *name, size_t len) {
+  for (int i = 0; i < GUAVA_HEADER_KNOWN_MAX; ++i) {
+    const char *known = guava_header_known_names[i];
+    if (strlen(known) == len && strncasecmp(known, name, len) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+const char *guava_header_known_name(guava_header_id_t id) {
+  return guava_header_known_names[id];
+}
+
+static guava_header_t *guava_headers_add(guava_headers_t *headers) {
+  if (headers->nentries == headers->size) {
+    size_t size = headers->size * 2;
+    guava_header_t *entries = NULL;
+
+    if (headers->entries == headers->inline_entries) {
+      entries = (guava_header_t *)guava_malloc(size * sizeof(*entries));
+      if (entries) {
+        memcpy(entries, headers->inline_entries, sizeof(headers->inline_entries));
+      }
+    } else {
+      entries = (guava_header_t *)guava_realloc(headers->entries, size * sizeof(*entries));
+    }
+
+    if (!entries) {
+      return NULL;
+    }
+
+    headers->entries = entries;
+    headers->size = size;
+  }
+
+  guava_header_t *header = &headers->entries[headers->nentries++];
+  memset(header, 0, sizeof(*header));
+  return header;
+}
+
+static guava_header_t *guava_headers_find(guava_headers_t *headers, const char *name, size_t len) {
+  for (size_t i = 0; i < headers->nentries; ++i) {
+    guava_header_t *header = &headers->entries[i];
+    if (header->name_len == len && strncasecmp(header->name, name, len) == 0) {
+      return header;
+    }
+  }
+
+  return NULL;
+}
+
+static guava_header_t *guava_headers_slot(guava_headers_t *headers, guava_header_id_t id) {
+  if (headers->known[id]) {
+    guava_header_t *header = &headers->entries[headers->known[id] - 1];
+    guava_header_free_value(header);
+    return header;
+  }
+
+  guava_header_t *header = guava_headers_add(headers);
+  if (!header) {
+    return NULL;
+  }
+
+  header->name = guava_header_known_names[id];
+  header->name_len = strlen(header->name);
+  headers->known[id] = (uint16_t)headers->nentries;
+  return header;
+}
+
+void guava_headers_set_known(guava_headers_t *headers, guava_header_id_t id, const char *value, size_t value_len) {
+  guava_header_t *header = guava_headers_slot(headers, id);
+  if (!header) {
+    return;
+  }
+
+  header->value = guava_string_new_size(value, value_len);
+  header->value_len = value_len;
+  header->flags |= GUAVA_HEADER_VALUE_OWNED;
+}
+
+void guava_headers_set_static(guava_headers_t *headers, guava_header_id_t id, const char *value) {
+  guava_header_t *header = guava_headers_slot(headers, id);
+  if (!header) {
+    return;
+  }
+
+  header->value = value;
+  header->value_len = strlen(value);
+}
+
+void guava_headers_set(guava_headers_t *headers, const char *name, size_t name_len, const char *value, size_t value_len) {
+  int id = guava_header_known_id(name, name_len);
+  if (id >= 0) {
+    guava_headers_set_known(headers, (guava_header_id_t)id, value, value_len);
+    return;
+  }
+
+  guava_header_t *header = guava_headers_find(headers, name, name_len);
+  if (header) {
+    guava_header_free_value(header);
+  } else {
+    header = guava_headers_add(headers);
+    if (!header) {
+      return;
+    }
+    header->name = guava_string_new_size(name, name_len);
+    header->name_len = name_len;
+    header->flags |= GUAVA_HEADER_NAME_OWNED;
+  }
+
+  header->value = guava_string_new_size(value, value_len);
+  header->value_len = value_len;
+  header->flags |= GUAVA_HEADER_VALUE_OWNED;
+}
+
+const guava_header_t *guava_headers_get_known(guava_headers_t *headers, guava_header_id_t id) {
+  if (!headers->known[id]) {
+    return NULL;
+  }
+
+  return &headers->entries[headers->known[id] - 1];
+}
+
+const guava_header_t *guava_headers_get(guava_headers_t *headers, const char *name, size_t len) {
+  int id = guava_header_known_id(name, len);
+  if (id >= 0) {
+    return guava_headers_get_known(headers, (guava_header_id_t)id);
+  }
+
+  return guava_headers_find(headers, name, len);
+}
+
+PyObject *guava_headers_to_dict(guava_headers_t *headers) {
+  PyObject *dict = PyDict_New();
+  if (!dict) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < headers->nentries; ++i) {
+    guava_header_t *header = &headers->entries[i];
+    PyObject *key = PyString_FromStringAndSize(header->name, header->name_len);
+    PyObject *value = PyString_FromStringAndSize(header->value, header->value_len);
+    if (key && value) {
+      PyDict_SetItem(dict, key, value);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+  }
+
+  return dict;
+}
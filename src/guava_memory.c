@@ -11,49 +11,186 @@
 
 const uint32_t guava_mem_magic_number = 0x526F636B;
 
-void *guava_malloc(size_t size)
-{
-  void *ptr = calloc(1, size + 8 + sizeof(size_t));
-  if (NULL == ptr) return NULL;
-  memcpy(ptr, &guava_mem_magic_number, 4);
-  memcpy(ptr + 4, &size, sizeof(size));
-  memcpy(ptr + size + 8 + sizeof(size_t) - 4, &guava_mem_magic_number, 4);
-  return ptr + 4 + sizeof(size_t);
-}
-
-void *
-guava_calloc(size_t count,
-	     size_t size)
-{
-  return guava_malloc(size * count);
-}
-
-void
-guava_free(void *ptr)
-{
-  void *p = ptr - 4 - sizeof(size_t);
-  assert(*((uint32_t *)p) == guava_mem_magic_number);
-  size_t size = *((size_t *)(p + 4));
-  assert(*((uint32_t *)(p + 4 + sizeof(size_t) + size)) == guava_mem_magic_number);
-  free(p);
-  p = NULL;
-}
-
-void *
-guava_realloc(void *ptr,
-	      size_t size)
-{
-  void *p = realloc(ptr - 4 - sizeof(size_t), 4 + sizeof(size_t) + size + 4);
-  memcpy(p + 4, &size, sizeof(size));
-  memcpy(p + 4 + sizeof(size_t) + size, &guava_mem_magic_number, 4);
-  return p + 4 + sizeof(size_t);
-}
-
-
-size_t
-guava_malloc_size(void *ptr)
-{
-  return (*(size_t *)(ptr - sizeof(size_t)));
+typedef struct guava_mem_block_s guava_mem_block_t;
+
+/* Put in front of every allocation, a trailing magic number follows the data */
+struct guava_mem_block_s {
+  size_t   size;
+  uint32_t site;  /* index into guava_mem_sites */
+  uint32_t magic;
+};
+
+/* Keeps the pointer handed out aligned like the one malloc returns */
+#define GUAVA_MEM_HEADER_SIZE ((sizeof(guava_mem_block_t) + 15) & ~(size_t)15)
+
+#define GUAVA_MEM_SITE_SLOTS (GUAVA_MEM_MAX_SITES * 2)
+
+static guava_mem_stats_t guava_mem_stats;
+static guava_mem_site_t guava_mem_sites[GUAVA_MEM_MAX_SITES];
+static uint16_t guava_mem_site_slots[GUAVA_MEM_SITE_SLOTS]; /* index + 1 into guava_mem_sites */
+
+static uint32_t guava_mem_site_lookup(const char *file, int line) {
+  size_t h = ((size_t)file >> 3) * 31 + (size_t)line;
+
+  for (size_t i = 0; i < GUAVA_MEM_SITE_SLOTS; ++i) {
+    size_t slot = (h + i) % GUAVA_MEM_SITE_SLOTS;
+    uint16_t idx = guava_mem_site_slots[slot];
+
+    if (idx == 0) {
+      if (guava_mem_stats.nsites >= GUAVA_MEM_MAX_SITES - 1) {
+        break;
+      }
+      idx = (uint16_t)++guava_mem_stats.nsites;
+      guava_mem_site_slots[slot] = idx;
+      guava_mem_sites[idx - 1].file = file;
+      guava_mem_sites[idx - 1].line = line;
+      return idx - 1;
+    }
+
+    guava_mem_site_t *site = &guava_mem_sites[idx - 1];
+    if (site->file == file && site->line == line) {
+      return idx - 1;
+    }
+  }
+
+  /* The table is full, the last entry takes everything else */
+  guava_mem_site_t *other = &guava_mem_sites[GUAVA_MEM_MAX_SITES - 1];
+  if (!other->file) {
+    other->file = "(other)";
+    guava_mem_stats.nsites = GUAVA_MEM_MAX_SITES;
+  }
+  return GUAVA_MEM_MAX_SITES - 1;
+}
+
+static guava_mem_block_t *guava_mem_block(void *ptr) {
+  guava_mem_block_t *block = (guava_mem_block_t *)((char *)ptr - GUAVA_MEM_HEADER_SIZE);
+  uint32_t tail;
+
+  assert(block->magic == guava_mem_magic_number);
+  memcpy(&tail, (char *)ptr + block->size, 4);
+  assert(tail == guava_mem_magic_number);
+  (void)tail;
+
+  return block;
+}
+
+static void guava_mem_track(guava_mem_block_t *block, size_t size, uint32_t site) {
+  block->size = size;
+  block->site = site;
+  block->magic = guava_mem_magic_number;
+  memcpy((char *)block + GUAVA_MEM_HEADER_SIZE + size, &guava_mem_magic_number, 4);
+
+  guava_mem_site_t *s = &guava_mem_sites[site];
+  ++s->live_objects;
+  s->live_bytes += size;
+
+  ++guava_mem_stats.live_objects;
+  guava_mem_stats.live_bytes += size;
+  if (guava_mem_stats.live_bytes > guava_mem_stats.peak_bytes) {
+    guava_mem_stats.peak_bytes = guava_mem_stats.live_bytes;
+  }
+}
+
+static void guava_mem_untrack(guava_mem_block_t *block) {
+  guava_mem_site_t *s = &guava_mem_sites[block->site];
+  --s->live_objects;
+  s->live_bytes -= block->size;
+
+  --guava_mem_stats.live_objects;
+  guava_mem_stats.live_bytes -= block->size;
+}
+
+void *guava_malloc_debug(size_t size, const char *file, int line) {
+  guava_mem_block_t *block = (guava_mem_block_t *)calloc(1, GUAVA_MEM_HEADER_SIZE + size + 4);
+  if (NULL == block) return NULL;
+
+  uint32_t site = guava_mem_site_lookup(file, line);
+  guava_mem_track(block, size, site);
+
+  ++guava_mem_sites[site].allocs;
+  ++guava_mem_stats.allocs;
+
+  return (char *)block + GUAVA_MEM_HEADER_SIZE;
+}
+
+void *guava_calloc_debug(size_t count, size_t size, const char *file, int line) {
+  return guava_malloc_debug(size * count, file, line);
+}
+
+void guava_free_debug(void *ptr) {
+  if (NULL == ptr) return;
+
+  guava_mem_block_t *block = guava_mem_block(ptr);
+  guava_mem_untrack(block);
+
+  ++guava_mem_sites[block->site].frees;
+  ++guava_mem_stats.frees;
+
+  block->magic = 0;
+  free(block);
+}
+
+void *guava_realloc_debug(void *ptr, size_t size, const char *file, int line) {
+  if (NULL == ptr) return guava_malloc_debug(size, file, line);
+
+  guava_mem_block_t *block = guava_mem_block(ptr);
+  uint32_t site = block->site;
+
+  guava_mem_untrack(block);
+
+  guava_mem_block_t *p = (guava_mem_block_t *)realloc(block, GUAVA_MEM_HEADER_SIZE + size + 4);
+  if (NULL == p) {
+    guava_mem_track(block, block->size, site);
+    return NULL;
+  }
+
+  /* A resized block stays accounted to the site which allocated it */
+  guava_mem_track(p, size, site);
+  return (char *)p + GUAVA_MEM_HEADER_SIZE;
+}
+
+size_t guava_malloc_size(void *ptr) {
+  return guava_mem_block(ptr)->size;
+}
+
+guava_bool_t guava_memory_stats(guava_mem_stats_t *stats) {
+  *stats = guava_mem_stats;
+  return GUAVA_TRUE;
+}
+
+const guava_mem_site_t *guava_memory_site(size_t idx) {
+  return idx < guava_mem_stats.nsites ? &guava_mem_sites[idx] : NULL;
+}
+
+void guava_memory_dump_leaks(FILE *fp) {
+  if (guava_mem_stats.live_objects == 0) {
+    return;
+  }
+
+  fprintf(fp, "guava: %zu blocks (%zu bytes) still allocated, peak %zu bytes\n",
+          guava_mem_stats.live_objects, guava_mem_stats.live_bytes, guava_mem_stats.peak_bytes);
+
+  for (size_t i = 0; i < guava_mem_stats.nsites; ++i) {
+    guava_mem_site_t *site = &guava_mem_sites[i];
+    if (site->live_objects == 0) {
+      continue;
+    }
+    fprintf(fp, "  %s:%d: %zu blocks, %zu bytes\n", site->file, site->line, site->live_objects, site->live_bytes);
+  }
+}
+
+#else
+
+guava_bool_t guava_memory_stats(guava_mem_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+  return GUAVA_FALSE;
+}
+
+const guava_mem_site_t *guava_memory_site(size_t idx) {
+  return NULL;
+}
+
+void guava_memory_dump_leaks(FILE *fp) {
 }
 
 #endif
@@ -37,3 +37,25 @@ const char *guava_mime_type_guess(const char *filename) {
 
   return "text/plain";
 }
+
+/* Worth gzipping, images other than svg are compressed already */
+guava_bool_t guava_mime_type_compressible(const char *mime_type) {
+  static const char *compressible[] = {
+    "application/javascript",
+    "application/json",
+    "application/xml",
+    "image/svg+xml",
+  };
+
+  if (strncmp(mime_type, "text/", 5) == 0) {
+    return GUAVA_TRUE;
+  }
+
+  for (int i = 0; i < sizeof(compressible) / sizeof(compressible[0]); ++i) {
+    if (strcmp(compressible[i], mime_type) == 0) {
+      return GUAVA_TRUE;
+    }
+  }
+
+  return GUAVA_FALSE;
+}
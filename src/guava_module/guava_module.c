@@ -21,6 +21,8 @@ extern PyObject *init_session(void);
 
 extern PyObject *init_cookie(void);
 
+extern PyObject *init_memory(void);
+
 guava_bool_t register_module(PyObject *package, const char *name, PyObject *module) {
   if (!module) {
     return GUAVA_FALSE;
@@ -45,6 +47,7 @@ PyObject *init_guava(void) {
   PyObject *router_module = NULL;
   PyObject *session_module = NULL;
   PyObject *cookie_module = NULL;
+  PyObject *memory_module = NULL;
 
   PyEval_InitThreads();
 
@@ -85,6 +88,11 @@ PyObject *init_guava(void) {
     return NULL;
   }
 
+  memory_module = init_memory();
+  if (!register_module(guava_module, "memory", memory_module)) {
+    return NULL;
+  }
+
   PyModule_AddStringConstant(guava_module, "version", GUAVA_VERSION);
 
   return guava_module;
@@ -6,7 +6,9 @@
 
 #include "guava.h"
 #include "guava_module.h"
+#include "guava_request.h"
 #include "guava_response.h"
+#include "guava_header.h"
 #include "guava_session/guava_session.h"
 #include "guava_cookie.h"
 #include "guava_memory.h"
@@ -136,13 +138,15 @@ static PyObject *Controller_set_cookie(Controller *self, PyObject *args, PyObjec
 static PyObject *Controller_write(Controller *self, PyObject *args) {
   guava_response_t *resp = self->resp;
 
-  char *data;
-  if (!PyArg_ParseTuple(args, "s", &data)) {
+  PyObject *data;
+  if (!PyArg_ParseTuple(args, "O", &data)) {
     PyErr_SetString(PyExc_TypeError, "error parameter");
     return NULL;
   }
 
-  guava_response_write_data(resp, data);
+  if (guava_response_write_object(resp, data) < 0) {
+    return NULL;
+  }
 
   Py_RETURN_TRUE;
 }
@@ -262,18 +266,38 @@ static PyObject *Controller_get_COOKIES(Controller *self, void *closure) {
   return self->req->COOKIES;
 }
 
-static PyObject *Controller_get_HEADERS(Controller *self, void *closure) {
+static PyObject *Controller_get_FILES(Controller *self, void *closure) {
   if (!self->req) {
     return PyDict_New();
   }
 
-  if (!self->req->HEADERS) {
-    self->req->HEADERS = PyDict_New();
+  if (!self->req->FILES) {
+    self->req->FILES = PyDict_New();
+  }
+
+  Py_INCREF(self->req->FILES);
+
+  return self->req->FILES;
+}
+
+static PyObject *Controller_get_HEADERS(Controller *self, void *closure) {
+  if (!self->req) {
+    return PyDict_New();
   }
 
-  Py_INCREF(self->req->HEADERS);
+  PyObject *HEADERS = guava_request_headers_dict(self->req);
+
+  Py_XINCREF(HEADERS);
+  return HEADERS;
+}
+
+static PyObject *Controller_get_RESPONSE_HEADERS(Controller *self, void *closure) {
+  if (!self->resp) {
+    return PyDict_New();
+  }
 
-  return self->req->HEADERS;
+  /* A snapshot of the response headers, use set_header to change them */
+  return guava_headers_to_dict(&self->resp->headers);
 }
 
 static PyGetSetDef Controller_getseter[] = {
@@ -282,6 +306,8 @@ static PyGetSetDef Controller_getseter[] = {
   {"POST", (getter)Controller_get_POST, NULL, "POST", NULL},
   {"SESSION", (getter)Controller_get_SESSION, NULL, "SESSION", NULL},
   {"HEADERS", (getter)Controller_get_HEADERS, NULL, "HEADERS", NULL},
+  {"FILES", (getter)Controller_get_FILES, NULL, "FILES", NULL},
+  {"RESPONSE_HEADERS", (getter)Controller_get_RESPONSE_HEADERS, NULL, "RESPONSE_HEADERS", NULL},
   {NULL}
 };
 
@@ -49,6 +49,9 @@ static int Handler_init(Handler *self, PyObject *args, PyObject *kwds) {
     return -1;
   }
 
+  /* __init__ may run more than once on the same object */
+  guava_handler_deinit(self->handler);
+
   self->handler->package = guava_string_new(package ? package : ".");
   self->handler->module = guava_string_new(module);
   self->handler->cls = guava_string_new(cls);
@@ -39,6 +39,8 @@ static int RedirectHandler_init(Handler *self, PyObject *args, PyObject *kwds) {
     return -1;
   }
 
+  guava_handler_deinit(self->handler);
+
   self->handler->flags |= GUAVA_HANDLER_REDIRECT;
   self->handler->args = PyTuple_New(1);
   PyTuple_SetItem(self->handler->args, 0, PyString_FromString(url));
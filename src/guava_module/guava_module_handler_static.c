@@ -46,6 +46,8 @@ static int StaticHandler_init(Handler *self, PyObject *args, PyObject *kwds) {
     return -1;
   }
 
+  guava_handler_deinit(self->handler);
+
   self->handler->flags |= GUAVA_HANDLER_VALID;
   self->handler->flags |= GUAVA_HANDLER_STATIC;
 
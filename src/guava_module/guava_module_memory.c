@@ -0,0 +1,86 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_module.h"
+#include "guava_memory.h"
+#include "guava_dispatch.h"
+
+static PyObject *memory_stats(PyObject *self, PyObject *args) {
+  guava_mem_stats_t mem;
+
+  if (!guava_memory_stats(&mem)) {
+    return Py_BuildValue("{s:O}", "enabled", Py_False);
+  }
+
+  PyObject *sites = PyList_New(0);
+  if (!sites) {
+    return NULL;
+  }
+
+  const guava_mem_site_t *site = NULL;
+  for (size_t i = 0; (site = guava_memory_site(i)); ++i) {
+    PyObject *v = Py_BuildValue("{s:s,s:i,s:K,s:K,s:n,s:n}",
+                                "file", site->file,
+                                "line", site->line,
+                                "allocs", (unsigned PY_LONG_LONG)site->allocs,
+                                "frees", (unsigned PY_LONG_LONG)site->frees,
+                                "live_objects", (Py_ssize_t)site->live_objects,
+                                "live_bytes", (Py_ssize_t)site->live_bytes);
+    if (!v) {
+      Py_DECREF(sites);
+      return NULL;
+    }
+    PyList_Append(sites, v);
+    Py_DECREF(v);
+  }
+
+  return Py_BuildValue("{s:O,s:K,s:K,s:n,s:n,s:n,s:N}",
+                       "enabled", Py_True,
+                       "allocs", (unsigned PY_LONG_LONG)mem.allocs,
+                       "frees", (unsigned PY_LONG_LONG)mem.frees,
+                       "live_objects", (Py_ssize_t)mem.live_objects,
+                       "live_bytes", (Py_ssize_t)mem.live_bytes,
+                       "peak_bytes", (Py_ssize_t)mem.peak_bytes,
+                       "sites", sites);
+}
+
+static PyObject *memory_dump_leaks(PyObject *self, PyObject *args) {
+  guava_memory_dump_leaks(stderr);
+  Py_RETURN_NONE;
+}
+
+static void memory_atexit(void) {
+  /* The process wide caches are no leaks, they go before the report */
+  guava_dispatch_free();
+  guava_memory_dump_leaks(stderr);
+}
+
+static PyMethodDef memory_module_methods[] = {
+  {"stats", memory_stats, METH_NOARGS, "counters of the GUAVA_MEM_DEBUG allocator"},
+  {"dump_leaks", memory_dump_leaks, METH_NOARGS, "print the blocks still allocated to stderr"},
+  {NULL}
+};
+
+PyObject *init_memory(void) {
+  PyObject* m;
+
+  m = Py_InitModule3("guava.memory", memory_module_methods, "guava.memory .");
+
+  if (!m) {
+    return NULL;
+  }
+
+#ifdef GUAVA_MEM_DEBUG
+  /*
+   * A C exit handler, the server shuts down on a signal with exit() and never
+   * reaches Py_Finalize. On a normal interpreter exit it runs after Py_Finalize,
+   * so whatever the interpreter released is not reported.
+   */
+  atexit(memory_atexit);
+#endif
+
+  return m;
+}
@@ -81,6 +81,7 @@ static int Request_init(Request *self, PyObject *args, PyObject *kwds) {
 
   if (HEADERS) {
     Py_INCREF(HEADERS);
+    Py_XDECREF(self->req->HEADERS);
     self->req->HEADERS = HEADERS;
   }
 
@@ -163,11 +164,22 @@ static PyObject *Request_get_COOKIES(Request *self, void *closure) {
   Py_RETURN_NONE;
 }
 
-static PyObject *Request_get_HEADERS(Request *self, void *closure) {
+static PyObject *Request_get_FILES(Request *self, void *closure) {
   guava_request_t *req = self->req;
-  Py_INCREF(req->HEADERS);
 
-  return req->HEADERS;
+  if (!req->FILES) {
+    req->FILES = PyDict_New();
+  }
+
+  Py_XINCREF(req->FILES);
+  return req->FILES;
+}
+
+static PyObject *Request_get_HEADERS(Request *self, void *closure) {
+  PyObject *HEADERS = guava_request_headers_dict(self->req);
+
+  Py_XINCREF(HEADERS);
+  return HEADERS;
 }
 
 static PyObject *Request_get_path(Request *self, void *closure) {
@@ -190,6 +202,7 @@ static PyGetSetDef Request_getseter[] = {
   {"GET", (getter)Request_get_GET, NULL, "GET", NULL},
   {"POST", (getter)Request_get_POST, NULL, "POST", NULL},
   {"COOKIES", (getter)Request_get_COOKIES, NULL, "COOKIES", NULL},
+  {"FILES", (getter)Request_get_FILES, NULL, "FILES", NULL},
   {NULL}
 };
 
@@ -20,6 +20,7 @@ static PyObject *Router_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 }
 
 static void Router_dealloc(Router *self) {
+  guava_router_free(self->router);
   ((Router *)self)->ob_type->tp_free((PyObject *)self);
 }
 
@@ -67,17 +68,12 @@ static PyObject *Router_route(Router *self, PyObject *args) {
     return NULL;
   }
 
-  PyObject *key = NULL, *value = NULL;
-  Py_ssize_t pos = 0;
-
-  while (PyDict_Next(self->router->routes, &pos, &key, &value)) {
-    if (strcmp(((Request *)req)->req->url, PyString_AsString(key)) == 0) {
-      Py_INCREF(value);
-      return value;
-    }
+  PyObject *handler = guava_router_custom_route(self->router, ((Request *)req)->req);
+  if (!handler) {
+    Py_RETURN_NONE;
   }
 
-  Py_RETURN_NONE;
+  return handler;
 }
 
 static PyObject *Router_routes(Router *self, PyObject *args) {
@@ -105,7 +101,6 @@ static PyObject *Router_register(Router *self, PyObject *args) {
   assert(path != NULL);
   assert(o != NULL);
 
-  Py_INCREF(o);
   PyDict_SetItemString(self->router->routes, path, o);
 
   Py_RETURN_TRUE;
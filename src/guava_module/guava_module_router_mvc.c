@@ -93,18 +93,12 @@ static PyObject *MVCRouter_route(MVCRouter *self, PyObject *args) {
     return NULL;
   }
 
-  guava_handler_t *handler = guava_handler_new();
-  guava_router_mvc_route((guava_router_mvc_t *)self->router.router, ((Request *)req)->req, handler);
-
-  if (!guava_handler_is_valid(handler)) {
-    guava_handler_free(handler);
+  PyObject *handler = guava_router_native_route(self->router.router, ((Request *)req)->req);
+  if (!handler) {
     Py_RETURN_NONE;
   }
 
-  Handler *handler_obj = PyObject_New(Handler, &HandlerType);
-  handler_obj->handler = handler;
-
-  return (PyObject *)handler_obj;
+  return handler;
 }
 
 static PyGetSetDef MVCRouter_getseter[] = {
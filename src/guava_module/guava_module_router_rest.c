@@ -91,24 +91,12 @@ static PyObject *RESTRouter_route(RESTRouter *self, PyObject *args) {
     return NULL;
   }
 
-  guava_handler_t *handler = guava_handler_new();
-  guava_router_rest_route((guava_router_rest_t *)self->router.router, ((Request *)req)->req, handler);
-
-  if (!guava_handler_is_valid(handler)) {
-    guava_handler_free(handler);
+  PyObject *handler = guava_router_native_route(self->router.router, ((Request *)req)->req);
+  if (!handler) {
     Py_RETURN_NONE;
   }
 
-  Handler *handler_obj = (Handler *)Handler_new(&HandlerType, NULL, NULL);
-
-  if (handler_obj->handler) {
-    guava_handler_free(handler_obj->handler);
-    handler_obj->handler = NULL;
-  }
-
-  handler_obj->handler = handler;
-
-  return (PyObject *)handler_obj;
+  return handler;
 }
 
 static PyGetSetDef RESTRouter_getseter[] = {
@@ -28,27 +28,44 @@ static void StaticRouter_dealloc(StaticRouter *self) {
 }
 
 static int StaticRouter_init(StaticRouter *self, PyObject *args, PyObject *kwds) {
-  static char *kwlist[] = {"mount_point", "directory", "allow_index", "session_store", NULL};
+  static char *kwlist[] = {"mount_point", "directory", "allow_index", "session_store", "memory_file_size", "cache_control", "gzip_static", "gzip", NULL};
 
   char *mount_point = NULL;
   char *directory = NULL;
   char allow_index = 0;
   SessionStore *session_store = NULL;
+  Py_ssize_t memory_file_size = GUAVA_ROUTER_STATIC_MEMORY_FILE_SIZE;
+  char *cache_control = NULL;
+  char gzip_static = 0;
+  char gzip = 0;
 
   if (!PyArg_ParseTupleAndKeywords(args,
                                    kwds,
-                                   "ss|bO",
+                                   "ss|bOnzbb",
                                    kwlist,
                                    &mount_point,
                                    &directory,
                                    &allow_index,
-                                   &session_store)) {
+                                   &session_store,
+                                   &memory_file_size,
+                                   &cache_control,
+                                   &gzip_static,
+                                   &gzip)) {
+    return -1;
+  }
+
+  if (memory_file_size < 0) {
+    PyErr_SetString(PyExc_ValueError, "memory_file_size must not be negative");
     return -1;
   }
 
   guava_router_set_mount_point((guava_router_t *)self->router.router, mount_point);
   guava_router_static_set_directory((guava_router_static_t *)self->router.router, directory);
   guava_router_static_set_allow_index((guava_router_static_t *)self->router.router, allow_index);
+  guava_router_static_set_memory_file_size((guava_router_static_t *)self->router.router, (size_t)memory_file_size);
+  guava_router_static_set_cache_control((guava_router_static_t *)self->router.router, cache_control);
+  guava_router_static_set_gzip_static((guava_router_static_t *)self->router.router, gzip_static);
+  guava_router_static_set_gzip((guava_router_static_t *)self->router.router, gzip);
 
   if (session_store) {
     Py_INCREF(session_store);
@@ -129,6 +146,98 @@ static int StaticRouter_set_allow_index(StaticRouter *self, PyObject *value, voi
   return 0;
 }
 
+static PyObject *StaticRouter_get_memory_file_size(StaticRouter *self, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  return PyInt_FromSize_t(router->memory_file_size);
+}
+
+static int StaticRouter_set_memory_file_size(StaticRouter *self, PyObject *value, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  if (value == NULL)  {
+    PyErr_SetString(PyExc_TypeError, "Cannot delete the memory_file_size attribute");
+    return -1;
+  }
+
+  Py_ssize_t size = PyNumber_AsSsize_t(value, PyExc_OverflowError);
+  if (size == -1 && PyErr_Occurred()) {
+    return -1;
+  }
+
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "The memory_file_size attribute value must not be negative");
+    return -1;
+  }
+
+  guava_router_static_set_memory_file_size(router, (size_t)size);
+  return 0;
+}
+
+static PyObject *StaticRouter_get_cache_control(StaticRouter *self, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  if (!router->cache_control) {
+    Py_RETURN_NONE;
+  }
+  return PyString_FromString(router->cache_control);
+}
+
+static int StaticRouter_set_cache_control(StaticRouter *self, PyObject *value, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  if (value == NULL || value == Py_None) {
+    guava_router_static_set_cache_control(router, NULL);
+    return 0;
+  }
+
+  if (!PyString_Check(value)) {
+    PyErr_SetString(PyExc_TypeError, "The cache_control attribute value must be a string or None");
+    return -1;
+  }
+
+  guava_router_static_set_cache_control(router, PyString_AsString(value));
+  return 0;
+}
+
+static PyObject *StaticRouter_get_gzip_static(StaticRouter *self, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  return PyBool_FromLong(router->gzip_static);
+}
+
+static int StaticRouter_set_gzip_static(StaticRouter *self, PyObject *value, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  if (value == NULL)  {
+    PyErr_SetString(PyExc_TypeError, "Cannot delete the gzip_static attribute");
+    return -1;
+  }
+
+  if (!PyBool_Check(value)) {
+    PyErr_SetString(PyExc_TypeError, "The gzip_static attribute value must be a boolean");
+    return -1;
+  }
+
+  guava_router_static_set_gzip_static(router, (guava_bool_t)PyInt_AsLong(value));
+  return 0;
+}
+
+static PyObject *StaticRouter_get_gzip(StaticRouter *self, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  return PyBool_FromLong(router->gzip);
+}
+
+static int StaticRouter_set_gzip(StaticRouter *self, PyObject *value, void *closure) {
+  guava_router_static_t *router = (guava_router_static_t *)self->router.router;
+  if (value == NULL)  {
+    PyErr_SetString(PyExc_TypeError, "Cannot delete the gzip attribute");
+    return -1;
+  }
+
+  if (!PyBool_Check(value)) {
+    PyErr_SetString(PyExc_TypeError, "The gzip attribute value must be a boolean");
+    return -1;
+  }
+
+  guava_router_static_set_gzip(router, (guava_bool_t)PyInt_AsLong(value));
+  return 0;
+}
+
 static PyObject *StaticRouter_route(StaticRouter *self, PyObject *args) {
   PyObject *req;
 
@@ -137,24 +246,22 @@ static PyObject *StaticRouter_route(StaticRouter *self, PyObject *args) {
     return NULL;
   }
 
-  guava_handler_t *handler = guava_handler_new();
-  guava_router_static_route((guava_router_static_t *)self->router.router, ((Request *)req)->req, handler);
-
-  if (!guava_handler_is_valid(handler)) {
-    guava_handler_free(handler);
+  PyObject *handler = guava_router_native_route(self->router.router, ((Request *)req)->req);
+  if (!handler) {
     Py_RETURN_NONE;
   }
 
-  StaticHandler *handler_obj = PyObject_New(StaticHandler, &StaticHandlerType);
-  handler_obj->handler = handler;
-
-  return (PyObject *)handler_obj;
+  return handler;
 }
 
 static PyGetSetDef StaticRouter_getseter[] = {
   {"mount_point", (getter)StaticRouter_get_mount_point, (setter)StaticRouter_set_mount_point, "the mount point of the router", NULL},
   {"directory", (getter)StaticRouter_get_directory, (setter)StaticRouter_set_directory, "directory", NULL},
   {"allow_index", (getter)StaticRouter_get_allow_index, (setter)StaticRouter_set_allow_index, "allow index", NULL},
+  {"memory_file_size", (getter)StaticRouter_get_memory_file_size, (setter)StaticRouter_set_memory_file_size, "files up to this size are served from memory", NULL},
+  {"cache_control", (getter)StaticRouter_get_cache_control, (setter)StaticRouter_set_cache_control, "Cache-Control sent along with the files", NULL},
+  {"gzip_static", (getter)StaticRouter_get_gzip_static, (setter)StaticRouter_set_gzip_static, "serve precompressed .br and .gz siblings", NULL},
+  {"gzip", (getter)StaticRouter_get_gzip, (setter)StaticRouter_set_gzip, "gzip compressible files once and keep them in memory", NULL},
   {NULL}
 };
 
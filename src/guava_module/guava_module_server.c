@@ -10,6 +10,7 @@
 #include "guava_router/guava_router.h"
 #include "guava_module_router.h"
 #include "guava_memory.h"
+#include "guava_dispatch.h"
 
 
 static PyObject *Server_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
@@ -34,25 +35,80 @@ static void Server_dealloc(Server *self) {
 }
 
 static int Server_init(Server *self, PyObject *args, PyObject *kwds) {
-  static char *kwlist[] = {"ip", "port", "backlog", "auto_reload", "debug", NULL};
+  static char *kwlist[] = {"ip", "port", "backlog", "auto_reload", "debug", "workers", "conn_high_water", "response_high_water",
+                           "header_timeout", "body_timeout", "keepalive_timeout", "write_timeout", "max_body_size", "upload_spill_size",
+                           "static_memory_budget", NULL};
+  Py_ssize_t max_body_size = 0;
+  Py_ssize_t upload_spill_size = GUAVA_SERVER_DEFAULT_UPLOAD_SPILL_SIZE;
+  Py_ssize_t static_memory_budget = GUAVA_FILE_CACHE_MEMORY_BUDGET;
 
   if (!PyArg_ParseTupleAndKeywords(args,
                                    kwds,
-                                   "|siibb",
+                                   "|siibbiiiiiiinnn",
                                    kwlist,
                                    &self->ip,
                                    &self->port,
                                    &self->backlog,
                                    &self->auto_reload,
-                                   &self->server->debug)) {
+                                   &self->server->debug,
+                                   &self->server->workers,
+                                   &self->server->conn_high_water,
+                                   &self->server->response_high_water,
+                                   &self->server->header_timeout,
+                                   &self->server->body_timeout,
+                                   &self->server->keepalive_timeout,
+                                   &self->server->write_timeout,
+                                   &max_body_size,
+                                   &upload_spill_size,
+                                   &static_memory_budget)) {
     return -1;
   }
 
+  if (self->server->workers < 1) {
+    PyErr_SetString(PyExc_ValueError, "workers must be at least 1");
+    return -1;
+  }
+
+  if (self->server->conn_high_water < 0 || self->server->response_high_water < 0) {
+    PyErr_SetString(PyExc_ValueError, "high water marks must not be negative");
+    return -1;
+  }
+
+  if (self->server->header_timeout < 0 ||
+      self->server->body_timeout < 0 ||
+      self->server->keepalive_timeout < 0 ||
+      self->server->write_timeout < 0) {
+    PyErr_SetString(PyExc_ValueError, "timeouts must not be negative");
+    return -1;
+  }
+
+  if (max_body_size < 0) {
+    PyErr_SetString(PyExc_ValueError, "max_body_size must not be negative");
+    return -1;
+  }
+  self->server->max_body_size = (size_t)max_body_size;
+
+  if (upload_spill_size < 0) {
+    PyErr_SetString(PyExc_ValueError, "upload_spill_size must not be negative");
+    return -1;
+  }
+  self->server->upload_spill_size = (size_t)upload_spill_size;
+
+  if (static_memory_budget < 0) {
+    PyErr_SetString(PyExc_ValueError, "static_memory_budget must not be negative");
+    return -1;
+  }
+  self->server->static_memory_budget = (size_t)static_memory_budget;
+
   return 0;
 }
 
 static PyObject *Server_serve(Server *self) {
-  guava_server_start(self->server, self->ip, self->port, self->backlog);
+  int err = guava_server_start(self->server, self->ip, self->port, self->backlog);
+  if (err) {
+    errno = err;
+    return PyErr_SetFromErrno(PyExc_IOError);
+  }
   Py_RETURN_NONE;
 }
 
@@ -68,8 +124,8 @@ static PyObject *Server_add_router(Server *self, PyObject *args) {
 
   for (Py_ssize_t i = 0; i < size; ++i) {
     router = (Router *)PyTuple_GetItem(args, i);
-    Py_INCREF(router);
 
+    /* The list of routers takes its own reference */
     guava_server_add_router(self->server, router);
   }
 
@@ -96,54 +152,23 @@ static PyObject *Server_route(Server *self, PyObject *args) {
     Py_RETURN_NONE;
   }
 
-  Py_ssize_t nrouters = PyList_Size(server->routers);
-  Handler *handler = NULL;
-
-  Router *router = (Router *)guava_router_get_best_matched_router(server->routers, req);
-
-  do {
-    if (!router) {
-      break;
-    }
-
-    handler = (Handler *)PyObject_CallMethod((PyObject *)router, "route", "(O)", req);
-    handler->handler->router = router->router;
-
-    for (Py_ssize_t i = 0; i < nrouters; ++i) {
-      router = (Router *)PyList_GetItem(server->routers, i);
-      if (router->router->type != GUAVA_ROUTER_CUSTOM) {
-        /*
-         * Cause we already try to get the best matched router
-         * But we still need to pass the custome router in case use defined some speciall routes
-         */
-        continue;
-      }
-      Handler *h = (Handler *)PyObject_CallMethod((PyObject *)router, "route", "(O)", req);
-      if ((PyObject *)h != Py_None) {
-        handler = h;
-        handler->handler->router = router->router;
-        break;
-      }
-    }
-
-    if (!handler || !handler->handler) {
-      break;
-    }
-
-    return (PyObject *)handler;
-  } while (0);
+  PyObject *handler = guava_router_route(server, req);
+  if (!handler) {
+    Py_RETURN_NONE;
+  }
 
-  Py_RETURN_NONE;
+  return handler;
 }
 
 
 static PyObject *Server_repr(Server *self) {
-  return PyString_FromFormat("Server listen(%s:%d), backlog(%d), auto_reload(%s), debug(%s)",
+  return PyString_FromFormat("Server listen(%s:%d), backlog(%d), auto_reload(%s), debug(%s), workers(%d)",
                              self->ip,
                              self->port,
                              self->backlog,
                              self->auto_reload ? "TRUE" : "FALSE",
-                             self->server->debug ? "TRUE" : "FALSE");
+                             self->server->debug ? "TRUE" : "FALSE",
+                             self->server->workers);
 }
 
 static PyObject *Server_get_routers(Server *self, void *closure) {
@@ -158,6 +183,94 @@ static PyObject *Server_get_routers(Server *self, void *closure) {
 
 }
 
+static PyObject *Server_get_workers(Server *self, void *closure) {
+  return PyInt_FromLong(self->server->workers);
+}
+
+static PyObject *Server_slab_stats(guava_slab_t *slab) {
+  return Py_BuildValue("{s:n,s:n,s:K,s:K}",
+                       "size", (Py_ssize_t)slab->size,
+                       "cached", (Py_ssize_t)slab->nfree,
+                       "hits", (unsigned PY_LONG_LONG)slab->hits,
+                       "misses", (unsigned PY_LONG_LONG)slab->misses);
+}
+
+static PyObject *Server_stats(Server *self) {
+  guava_server_t *server = self->server;
+  PyObject *stats = PyDict_New();
+  PyObject *v = NULL;
+
+  v = Server_slab_stats(&server->read_buffers);
+  PyDict_SetItemString(stats, "read_buffers", v);
+  Py_DECREF(v);
+
+  v = Server_slab_stats(&server->idle_read_buffers);
+  PyDict_SetItemString(stats, "idle_read_buffers", v);
+  Py_DECREF(v);
+
+  v = Server_slab_stats(&server->header_buffers);
+  PyDict_SetItemString(stats, "header_buffers", v);
+  Py_DECREF(v);
+
+  v = Server_slab_stats(&server->conns);
+  PyDict_SetItemString(stats, "conns", v);
+  Py_DECREF(v);
+
+  v = Server_slab_stats(&server->responses);
+  PyDict_SetItemString(stats, "responses", v);
+  Py_DECREF(v);
+
+  v = PyInt_FromSize_t(server->timers.count);
+  PyDict_SetItemString(stats, "timers", v);
+  Py_DECREF(v);
+
+  guava_dispatch_cache_t *dispatch = guava_dispatch_cache();
+  v = Py_BuildValue("{s:n,s:K,s:K}",
+                    "size", (Py_ssize_t)dispatch->count,
+                    "hits", (unsigned PY_LONG_LONG)dispatch->hits,
+                    "misses", (unsigned PY_LONG_LONG)dispatch->misses);
+  PyDict_SetItemString(stats, "dispatch", v);
+  Py_DECREF(v);
+
+  size_t routes = 0;
+  uint64_t route_hits = 0, route_misses = 0;
+  /* No routers are set until add_router or serve */
+  Py_ssize_t nrouters = server->routers ? PyList_Size(server->routers) : 0;
+  for (Py_ssize_t i = 0; i < nrouters; ++i) {
+    guava_router_cache_t *cache = ((Router *)PyList_GetItem(server->routers, i))->router->cache;
+    if (cache) {
+      routes += cache->count;
+      route_hits += cache->hits;
+      route_misses += cache->misses;
+    }
+  }
+  v = Py_BuildValue("{s:n,s:K,s:K}",
+                    "size", (Py_ssize_t)routes,
+                    "hits", (unsigned PY_LONG_LONG)route_hits,
+                    "misses", (unsigned PY_LONG_LONG)route_misses);
+  PyDict_SetItemString(stats, "route_cache", v);
+  Py_DECREF(v);
+
+  v = Py_BuildValue("{s:n,s:K,s:K,s:K,s:K,s:n,s:n}",
+                    "size", (Py_ssize_t)server->files.count,
+                    "hits", (unsigned PY_LONG_LONG)server->files.hits,
+                    "misses", (unsigned PY_LONG_LONG)server->files.misses,
+                    "invalidations", (unsigned PY_LONG_LONG)server->files.invalidations,
+                    "evictions", (unsigned PY_LONG_LONG)server->files.evictions,
+                    "memory_files", (Py_ssize_t)server->files.memory_count,
+                    "memory_bytes", (Py_ssize_t)server->files.memory_used);
+  PyDict_SetItemString(stats, "file_cache", v);
+  Py_DECREF(v);
+
+#ifdef GUAVA_MEM_DEBUG
+  v = PyInt_FromSize_t(server->arena_high_water);
+  PyDict_SetItemString(stats, "arena_high_water", v);
+  Py_DECREF(v);
+#endif
+
+  return stats;
+}
+
 static PyMemberDef Server_members[] = {
   {"ip", T_STRING, offsetof(Server, ip), 0, "ip"},
   {"port", T_INT, offsetof(Server, port), 0, "port"},
@@ -166,15 +279,23 @@ static PyMemberDef Server_members[] = {
   {NULL}
 };
 
+static PyObject *Server_clear_dispatch_cache(Server *self) {
+  guava_dispatch_invalidate();
+  Py_RETURN_NONE;
+}
+
 static PyMethodDef Server_methods[] = {
   {"add_router", (PyCFunction)Server_add_router, METH_VARARGS, "add one router"},
   {"serve", (PyCFunction)Server_serve, METH_NOARGS, "start the web server"},
   {"route", (PyCFunction)Server_route, METH_VARARGS, "get specified handler according different request"},
+  {"stats", (PyCFunction)Server_stats, METH_NOARGS, "get the runtime statistics of the current worker"},
+  {"clear_dispatch_cache", (PyCFunction)Server_clear_dispatch_cache, METH_NOARGS, "forget the cached controller classes, e.g. after reloading modules"},
   {NULL}
 };
 
 static PyGetSetDef Server_getseter[] = {
   {"routers", (getter)Server_get_routers, NULL, "get routers", NULL},
+  {"workers", (getter)Server_get_workers, NULL, "number of worker processes", NULL},
   {NULL}
 };
 
@@ -252,7 +373,11 @@ static PyObject *server_start_static_server(PyObject *self, PyObject *args, PyOb
   guava_server_add_router(server, (Router *)router);
   Py_DECREF(router);
 
-  guava_server_start(server, ip, port, GUAVA_SERVER_DEFAULT_LISTEN_BACKLOG);
+  int err = guava_server_start(server, ip, port, GUAVA_SERVER_DEFAULT_LISTEN_BACKLOG);
+  if (err) {
+    errno = err;
+    return PyErr_SetFromErrno(PyExc_IOError);
+  }
 
   Py_RETURN_NONE;
 }
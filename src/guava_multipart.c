@@ -0,0 +1,427 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_multipart.h"
+#include "guava_string.h"
+#include "guava_strbuf.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define GUAVA_MULTIPART_MAX_HEADER_SIZE 8192
+
+enum {
+  GUAVA_MULTIPART_PREAMBLE = 0,
+  GUAVA_MULTIPART_AFTER_BOUNDARY,
+  GUAVA_MULTIPART_AFTER_CR,
+  GUAVA_MULTIPART_AFTER_DASH,
+  GUAVA_MULTIPART_HEADERS,
+  GUAVA_MULTIPART_BODY,
+  GUAVA_MULTIPART_DONE,
+  GUAVA_MULTIPART_ERROR
+};
+
+static const char *guava_multipart_skip_spaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) {
+    ++p;
+  }
+  return p;
+}
+
+/*
+ * Find the parameter key in a header value like
+ * form-data; name="file"; filename="a.txt", quotes are optional.
+ */
+static guava_bool_t guava_multipart_param(const char *s, size_t len, const char *key, guava_string_t *value) {
+  const char *end = s + len;
+  const char *p = memchr(s, ';', len);
+  size_t key_len = strlen(key);
+
+  while (p && p < end) {
+    p = guava_multipart_skip_spaces(p + 1, end);
+
+    const char *equal = memchr(p, '=', end - p);
+    if (!equal) {
+      break;
+    }
+
+    const char *v = equal + 1;
+    const char *v_end = NULL;
+    const char *next = NULL;
+
+    if (v < end && *v == '"') {
+      ++v;
+      v_end = memchr(v, '"', end - v);
+      if (!v_end) {
+        break;
+      }
+      next = memchr(v_end, ';', end - v_end);
+    } else {
+      next = memchr(v, ';', end - v);
+      v_end = next ? next : end;
+      while (v_end > v && (v_end[-1] == ' ' || v_end[-1] == '\t')) {
+        --v_end;
+      }
+    }
+
+    if ((size_t)(equal - p) == key_len && strncasecmp(p, key, key_len) == 0) {
+      *value = guava_string_new_size(v, v_end - v);
+      return GUAVA_TRUE;
+    }
+
+    p = next;
+  }
+
+  return GUAVA_FALSE;
+}
+
+guava_bool_t guava_multipart_boundary(const char *content_type, size_t len, guava_string_t *boundary) {
+  guava_string_t token = NULL;
+
+  if (!guava_multipart_param(content_type, len, "boundary", &token)) {
+    return GUAVA_FALSE;
+  }
+
+  if (!guava_string_len(token)) {
+    guava_string_free(token);
+    return GUAVA_FALSE;
+  }
+
+  /* The body is matched against CRLF--boundary */
+  *boundary = guava_string_append(guava_string_new("\r\n--"), token);
+  guava_string_free(token);
+  return GUAVA_TRUE;
+}
+
+static void guava_multipart_reset_part(guava_multipart_parser_t *parser) {
+  /* The buffers keep their room for the next part */
+  guava_strbuf_clear(&parser->header);
+  guava_strbuf_clear(&parser->data);
+  if (parser->name) {
+    guava_string_free(parser->name);
+    parser->name = NULL;
+  }
+  if (parser->filename) {
+    guava_string_free(parser->filename);
+    parser->filename = NULL;
+  }
+  if (parser->content_type) {
+    guava_string_free(parser->content_type);
+    parser->content_type = NULL;
+  }
+  if (parser->path) {
+    guava_string_free(parser->path);
+    parser->path = NULL;
+  }
+  if (parser->fd >= 0) {
+    close(parser->fd);
+    parser->fd = -1;
+  }
+  parser->size = 0;
+}
+
+void guava_multipart_parser_init(guava_multipart_parser_t *parser, guava_string_t boundary, size_t spill_size) {
+  memset(parser, 0, sizeof(*parser));
+  guava_strbuf_init(&parser->header);
+  guava_strbuf_init(&parser->data);
+  parser->state = GUAVA_MULTIPART_PREAMBLE;
+  parser->boundary = boundary;
+  /* The first boundary has no CRLF in front of it */
+  parser->matched = 2;
+  parser->fd = -1;
+  parser->spill_size = spill_size;
+}
+
+void guava_multipart_parser_deinit(guava_multipart_parser_t *parser) {
+  guava_multipart_reset_part(parser);
+  guava_strbuf_deinit(&parser->header);
+  guava_strbuf_deinit(&parser->data);
+
+  if (parser->boundary) {
+    guava_string_free(parser->boundary);
+    parser->boundary = NULL;
+  }
+
+  /* Uploads the application did not move away are removed with the request */
+  if (parser->tmp_files) {
+    Py_ssize_t n = PyList_GET_SIZE(parser->tmp_files);
+    for (Py_ssize_t i = 0; i < n; ++i) {
+      unlink(PyString_AS_STRING(PyList_GET_ITEM(parser->tmp_files, i)));
+    }
+    Py_CLEAR(parser->tmp_files);
+  }
+}
+
+static guava_bool_t guava_multipart_write(int fd, const char *buf, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return GUAVA_FALSE;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return GUAVA_TRUE;
+}
+
+static guava_bool_t guava_multipart_spill(guava_multipart_parser_t *parser) {
+  const char *dir = getenv("TMPDIR");
+  char path[MAXPATH];
+
+  snprintf(path, sizeof(path), "%s/guava-upload-XXXXXX", dir && *dir ? dir : "/tmp");
+  parser->fd = mkstemp(path);
+  if (parser->fd < 0) {
+    fprintf(stderr, "failed to create the upload file %s: %s\n", path, strerror(errno));
+    return GUAVA_FALSE;
+  }
+
+  parser->path = guava_string_new(path);
+
+  if (!parser->tmp_files) {
+    parser->tmp_files = PyList_New(0);
+  }
+  PyObject *p = PyString_FromString(path);
+  PyList_Append(parser->tmp_files, p);
+  Py_DECREF(p);
+
+  if (parser->data.len) {
+    guava_bool_t ok = guava_multipart_write(parser->fd, parser->data.data, parser->data.len);
+    if (!ok) {
+      fprintf(stderr, "failed to write the upload file %s: %s\n", path, strerror(errno));
+    }
+    guava_strbuf_deinit(&parser->data);
+    return ok;
+  }
+
+  return GUAVA_TRUE;
+}
+
+static void guava_multipart_part_data(guava_multipart_parser_t *parser, const char *buf, size_t len) {
+  if (!len || parser->state == GUAVA_MULTIPART_ERROR) {
+    return;
+  }
+
+  /* Only file parts go to disk, plain fields always stay in memory */
+  if (parser->fd < 0 && parser->filename && parser->size + len > parser->spill_size) {
+    if (!guava_multipart_spill(parser)) {
+      parser->state = GUAVA_MULTIPART_ERROR;
+      parser->failed = 1;
+      return;
+    }
+  }
+
+  parser->size += len;
+
+  if (parser->fd >= 0) {
+    if (!guava_multipart_write(parser->fd, buf, len)) {
+      fprintf(stderr, "failed to write the upload file %s: %s\n", parser->path, strerror(errno));
+      parser->state = GUAVA_MULTIPART_ERROR;
+      parser->failed = 1;
+    }
+    return;
+  }
+
+  guava_strbuf_append(&parser->data, buf, len);
+}
+
+static void guava_multipart_part_headers(guava_multipart_parser_t *parser) {
+  const char *p = parser->header.data;
+  const char *end = p + parser->header.len;
+
+  while (p < end) {
+    const char *eol = memchr(p, '\r', end - p);
+    if (!eol) {
+      eol = end;
+    }
+
+    const char *colon = memchr(p, ':', eol - p);
+    if (colon) {
+      size_t name_len = colon - p;
+      const char *value = guava_multipart_skip_spaces(colon + 1, eol);
+
+      if (name_len == sizeof("Content-Disposition") - 1 && strncasecmp(p, "Content-Disposition", name_len) == 0) {
+        guava_multipart_param(value, eol - value, "name", &parser->name);
+        guava_multipart_param(value, eol - value, "filename", &parser->filename);
+      } else if (name_len == sizeof("Content-Type") - 1 && strncasecmp(p, "Content-Type", name_len) == 0) {
+        parser->content_type = guava_string_new_size(value, eol - value);
+      }
+    }
+
+    p = eol + 2;
+  }
+
+  guava_strbuf_clear(&parser->header);
+}
+
+static void guava_multipart_part_end(guava_multipart_parser_t *parser, PyObject *fields, PyObject *files) {
+  if (parser->state == GUAVA_MULTIPART_ERROR || !parser->name) {
+    guava_multipart_reset_part(parser);
+    return;
+  }
+
+  PyObject *key = PyString_FromStringAndSize(parser->name, guava_string_len(parser->name));
+
+  if (!parser->filename) {
+    PyObject *value = PyString_FromStringAndSize(parser->data.data ? parser->data.data : "", parser->data.len);
+    PyDict_SetItem(fields, key, value);
+    Py_DECREF(value);
+  } else {
+    PyObject *file = Py_BuildValue("{s:s,s:s,s:n}",
+                                   "filename", parser->filename,
+                                   "content_type", parser->content_type ? parser->content_type : "application/octet-stream",
+                                   "size", (Py_ssize_t)parser->size);
+    PyObject *value = NULL;
+    if (parser->path) {
+      value = PyString_FromString(parser->path);
+      PyDict_SetItemString(file, "path", value);
+    } else {
+      value = PyString_FromStringAndSize(parser->data.data ? parser->data.data : "", parser->data.len);
+      PyDict_SetItemString(file, "body", value);
+    }
+    Py_DECREF(value);
+
+    PyDict_SetItem(files, key, file);
+    Py_DECREF(file);
+  }
+
+  Py_DECREF(key);
+  guava_multipart_reset_part(parser);
+}
+
+void guava_multipart_parser_execute(guava_multipart_parser_t *parser, const char *buf, size_t len, PyObject *fields, PyObject *files) {
+  const char *boundary = parser->boundary;
+  size_t boundary_len = guava_string_len(parser->boundary);
+  size_t i = 0;
+
+  while (i < len) {
+    switch (parser->state) {
+    case GUAVA_MULTIPART_PREAMBLE:
+    case GUAVA_MULTIPART_BODY: {
+      size_t start = i;
+      guava_bool_t in_body = parser->state == GUAVA_MULTIPART_BODY;
+
+      while (i < len) {
+        if (!parser->matched) {
+          /* Skip to the next possible boundary */
+          const char *cr = memchr(buf + i, '\r', len - i);
+          if (!cr) {
+            i = len;
+            break;
+          }
+          i = cr - buf;
+        }
+
+        if (buf[i] == boundary[parser->matched]) {
+          if (!parser->matched && in_body) {
+            guava_multipart_part_data(parser, buf + start, i - start);
+          }
+          ++i;
+          if (++parser->matched == boundary_len) {
+            parser->matched = 0;
+            if (in_body) {
+              guava_multipart_part_end(parser, fields, files);
+            }
+            parser->state = GUAVA_MULTIPART_AFTER_BOUNDARY;
+            start = i;
+            break;
+          }
+          start = i;
+          continue;
+        }
+
+        if (parser->matched) {
+          /* The bytes taken for a boundary were data after all */
+          if (in_body) {
+            guava_multipart_part_data(parser, boundary, parser->matched);
+          }
+          parser->matched = 0;
+          start = i;
+          if (buf[i] == boundary[0]) {
+            continue;
+          }
+        }
+        ++i;
+      }
+
+      if (in_body && parser->state == GUAVA_MULTIPART_BODY && !parser->matched) {
+        guava_multipart_part_data(parser, buf + start, i - start);
+      }
+      break;
+    }
+
+    case GUAVA_MULTIPART_AFTER_BOUNDARY:
+      if (buf[i] == '\r') {
+        parser->state = GUAVA_MULTIPART_AFTER_CR;
+      } else if (buf[i] == '-') {
+        parser->state = GUAVA_MULTIPART_AFTER_DASH;
+      } else if (buf[i] != ' ' && buf[i] != '\t') {
+        parser->state = GUAVA_MULTIPART_ERROR;
+      }
+      ++i;
+      break;
+
+    case GUAVA_MULTIPART_AFTER_CR:
+      parser->state = buf[i] == '\n' ? GUAVA_MULTIPART_HEADERS : GUAVA_MULTIPART_ERROR;
+      /* The CRLF ending the boundary line counts, a part may have no headers */
+      parser->header_matched = 2;
+      ++i;
+      break;
+
+    case GUAVA_MULTIPART_AFTER_DASH:
+      parser->state = buf[i] == '-' ? GUAVA_MULTIPART_DONE : GUAVA_MULTIPART_ERROR;
+      ++i;
+      break;
+
+    case GUAVA_MULTIPART_HEADERS: {
+      static const char *crlfcrlf = "\r\n\r\n";
+      size_t start = i;
+
+      while (i < len && parser->header_matched < 4) {
+        if (buf[i] == crlfcrlf[parser->header_matched]) {
+          ++parser->header_matched;
+        } else {
+          parser->header_matched = buf[i] == '\r' ? 1 : 0;
+        }
+        ++i;
+      }
+
+      guava_strbuf_append(&parser->header, buf + start, i - start);
+
+      if (parser->header.len > GUAVA_MULTIPART_MAX_HEADER_SIZE) {
+        parser->state = GUAVA_MULTIPART_ERROR;
+      } else if (parser->header_matched == 4) {
+        guava_multipart_part_headers(parser);
+        parser->state = GUAVA_MULTIPART_BODY;
+      }
+      break;
+    }
+
+    case GUAVA_MULTIPART_DONE:
+    case GUAVA_MULTIPART_ERROR:
+    default:
+      return;
+    }
+  }
+}
+
+void guava_multipart_parser_finish(guava_multipart_parser_t *parser) {
+  /* A part without its closing boundary is dropped */
+  guava_multipart_reset_part(parser);
+}
+
+/* The status code to reject the request with, 0 while the body is fine */
+int guava_multipart_parser_status(const guava_multipart_parser_t *parser) {
+  if (parser->failed) {
+    return 500;
+  }
+
+  return parser->state == GUAVA_MULTIPART_ERROR ? 400 : 0;
+}
@@ -6,6 +6,8 @@
 
 #include "guava_request.h"
 #include "guava_string.h"
+#include "guava_strbuf.h"
+#include "guava_arena.h"
 #include "guava_conn.h"
 #include "guava_server.h"
 #include "guava_response.h"
@@ -17,8 +19,13 @@
 #include "guava_cookie.h"
 #include "guava_memory.h"
 #include "guava_url.h"
+#include "guava_form.h"
+#include "guava_multipart.h"
+#include "guava_dispatch.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <strings.h>
 
 static guava_request_method_t guava_request_methods[] = {
   {0, "DELETE"},
@@ -65,11 +72,18 @@ guava_request_t *guava_request_new(void) {
   req->host = NULL;
   req->body = NULL;
 
-  req->HEADERS = PyDict_New();
-  if (!req->HEADERS) {
-    guava_free(req);
-    return NULL;
-  }
+  req->headers = req->inline_headers;
+  req->nheaders = 0;
+  req->headers_size = GUAVA_REQUEST_INLINE_HEADERS;
+  req->header_data = NULL;
+  req->HEADERS = NULL;
+
+  req->body_type = GUAVA_REQUEST_BODY_RAW;
+  req->body_size = 0;
+  guava_strbuf_init(&req->body_buf);
+  guava_form_parser_init(&req->form);
+  guava_multipart_parser_init(&req->multipart, NULL, 0);
+  req->FILES = NULL;
 
   req->major = 1;
   req->minor = 1;
@@ -77,14 +91,12 @@ guava_request_t *guava_request_new(void) {
 
   req->GET = PyDict_New();
   if (!req->GET) {
-    Py_DECREF(req->HEADERS);
     guava_free(req);
     return NULL;
   }
 
   req->POST = PyDict_New();
   if (!req->POST) {
-    Py_DECREF(req->HEADERS);
     Py_DECREF(req->GET);
     guava_free(req);
     return NULL;
@@ -92,7 +104,6 @@ guava_request_t *guava_request_new(void) {
 
   req->COOKIES = PyDict_New();
   if (!req->COOKIES) {
-    Py_DECREF(req->HEADERS);
     Py_DECREF(req->GET);
     Py_DECREF(req->POST);
     guava_free(req);
@@ -123,6 +134,25 @@ void guava_request_free(guava_request_t *req) {
     req->body = NULL;
   }
 
+  if (req->headers != req->inline_headers) {
+    guava_free(req->headers);
+    req->headers = NULL;
+  }
+
+  if (req->header_data) {
+    guava_string_free(req->header_data);
+    req->header_data = NULL;
+  }
+
+  guava_strbuf_deinit(&req->body_buf);
+  guava_form_parser_deinit(&req->form);
+  guava_multipart_parser_deinit(&req->multipart);
+
+  if (req->FILES) {
+    Py_DECREF(req->FILES);
+    req->FILES = NULL;
+  }
+
   if (req->HEADERS) {
     Py_DECREF(req->HEADERS);
     req->HEADERS = NULL;
@@ -161,13 +191,17 @@ int guava_request_on_message_begin(http_parser *parser) {
 
   Request *request = (Request *)PyObject_New(Request, &RequestType);
 
+  if (!request) {
+    return -1;
+  }
+
   request->req = guava_request_new();
+  request->req->arena = &conn->arena;
   conn->request = (PyObject *)request;
-  Py_INCREF(request);
+  conn->auxiliary_last_was_header = 0;
+  conn->in_body = 0;
 
-  if (!conn->request) {
-    return -1;
-  }
+  guava_conn_set_timeout(conn, conn->server->header_timeout);
 
   return 0;
 }
@@ -180,9 +214,9 @@ void guava_request_extract_from_url(guava_request_t *req) {
   char *ptr = strchr(req->url, '?');
 
   if (!ptr) {
-    req->path = guava_string_new(req->url);
+    req->path = guava_string_arena_new_size(req->arena, req->url, guava_string_len(req->url));
   } else {
-    req->path = guava_string_new_size(req->url, ptr - (char *)req->url);
+    req->path = guava_string_arena_new_size(req->arena, req->url, ptr - (char *)req->url);
     ptr += 1;
     if (ptr != NULL) {
       char *and_ptr = strchr(ptr, '&');
@@ -198,14 +232,12 @@ void guava_request_extract_from_url(guava_request_t *req) {
           }
           break;
         } else {
-          guava_string_t v = guava_string_new_size(ptr, and_ptr-ptr);
           equal_ptr = strchr(ptr, '=');
           if (equal_ptr) {
             PyObject *key = PyString_FromStringAndSize(ptr, equal_ptr-ptr);
             PyObject *value = PyString_FromStringAndSize(equal_ptr+1, and_ptr-equal_ptr-1);
             PyDict_SetItem(req->GET, key, value);
           }
-          guava_string_free(v);
           ptr = and_ptr + 1;
           if (!ptr) {
             break;
@@ -220,41 +252,177 @@ void guava_request_extract_from_url(guava_request_t *req) {
 int guava_request_on_url(http_parser *parser, const char *buf, size_t len) {
   guava_conn_t *conn = (guava_conn_t *)parser->data;
   Request *request = (Request *)conn->request;
-  request->req->url = guava_string_new_size(buf, len);
 
-  guava_request_extract_from_url(request->req);
+  /* The url may arrive in several pieces, it is split at headers complete */
+  request->req->url = guava_string_arena_append_raw_size(request->req->arena, request->req->url, buf, len);
   return 0;
 }
 
+static const char *guava_slice_ptr(guava_request_t *req, guava_slice_t *slice) {
+  return slice->base ? slice->base : req->header_data + slice->offset;
+}
+
+static void guava_slice_append(guava_request_t *req, guava_slice_t *slice, const char *buf, size_t len) {
+  if (!slice->len) {
+    slice->base = buf;
+    slice->len = len;
+    return;
+  }
+
+  /* The parser only splits a token at the end of a read */
+  if (slice->base && slice->base + slice->len == buf) {
+    slice->len += len;
+    return;
+  }
+
+  size_t data_len = req->header_data ? guava_string_len(req->header_data) : 0;
+  if (slice->base || slice->offset + slice->len != data_len) {
+    req->header_data = guava_string_arena_append_raw_size(req->arena, req->header_data, guava_slice_ptr(req, slice), slice->len);
+    slice->base = NULL;
+    slice->offset = data_len;
+  }
+
+  req->header_data = guava_string_arena_append_raw_size(req->arena, req->header_data, buf, len);
+  slice->len += len;
+}
+
+static guava_request_header_t *guava_request_add_header(guava_request_t *req) {
+  if (req->nheaders == req->headers_size) {
+    size_t size = req->headers_size * 2;
+    guava_request_header_t *headers = NULL;
+
+    if (req->headers == req->inline_headers) {
+      headers = (guava_request_header_t *)guava_malloc(size * sizeof(*headers));
+      if (headers) {
+        memcpy(headers, req->inline_headers, sizeof(req->inline_headers));
+      }
+    } else {
+      headers = (guava_request_header_t *)guava_realloc(req->headers, size * sizeof(*headers));
+    }
+
+    if (!headers) {
+      return NULL;
+    }
+
+    req->headers = headers;
+    req->headers_size = size;
+  }
+
+  guava_request_header_t *header = &req->headers[req->nheaders++];
+  memset(header, 0, sizeof(*header));
+  return header;
+}
+
 int guava_request_on_header_field(http_parser *parser, const char *buf, size_t len) {
   guava_conn_t *conn = (guava_conn_t *)parser->data;
+  guava_request_t *req = ((Request *)conn->request)->req;
 
-  if (conn->auxiliary_last_was_header) {
-    return -1;
+  if (!conn->auxiliary_last_was_header || !req->nheaders) {
+    if (!guava_request_add_header(req)) {
+      return -1;
+    }
   }
 
-  conn->auxiliary_current_header = guava_string_new_size(buf, len);
+  guava_slice_append(req, &req->headers[req->nheaders - 1].name, buf, len);
   conn->auxiliary_last_was_header = 1;
   return 0;
 }
 
 int guava_request_on_header_value(http_parser *parser, const char *buf, size_t len) {
   guava_conn_t *conn = (guava_conn_t *)parser->data;
-  Request *request = (Request *)conn->request;
+  guava_request_t *req = ((Request *)conn->request)->req;
 
-  if (conn->auxiliary_last_was_header && conn->auxiliary_current_header) {
-    PyObject *v = PyString_FromStringAndSize(buf, len);
-    PyDict_SetItemString(request->req->HEADERS, conn->auxiliary_current_header, v);
-    Py_DECREF(v);
-    guava_string_free(conn->auxiliary_current_header);
-    conn->auxiliary_current_header = NULL;
+  if (!req->nheaders) {
+    return -1;
   }
 
+  guava_slice_append(req, &req->headers[req->nheaders - 1].value, buf, len);
   conn->auxiliary_last_was_header = 0;
-
   return 0;
 }
 
+const char *guava_request_get_header(guava_request_t *req, const char *name, size_t *len) {
+  size_t name_len = strlen(name);
+
+  for (size_t i = req->nheaders; i > 0; --i) {
+    guava_request_header_t *header = &req->headers[i - 1];
+    if (header->name.len == name_len &&
+        strncasecmp(guava_slice_ptr(req, &header->name), name, name_len) == 0) {
+      *len = header->value.len;
+      return guava_slice_ptr(req, &header->value);
+    }
+  }
+
+  return NULL;
+}
+
+void guava_request_retain_headers(guava_request_t *req) {
+  for (size_t i = 0; i < req->nheaders; ++i) {
+    guava_slice_t *slices[2] = {&req->headers[i].name, &req->headers[i].value};
+    for (int j = 0; j < 2; ++j) {
+      guava_slice_t *slice = slices[j];
+      if (!slice->base) {
+        continue;
+      }
+      size_t data_len = req->header_data ? guava_string_len(req->header_data) : 0;
+      req->header_data = guava_string_arena_append_raw_size(req->arena, req->header_data, slice->base, slice->len);
+      slice->base = NULL;
+      slice->offset = data_len;
+    }
+  }
+}
+
+void guava_request_retain(guava_request_t *req) {
+  guava_string_t *strs[] = {&req->url, &req->path, &req->host, &req->header_data};
+
+  req->arena = NULL;
+
+  for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i) {
+    if (*strs[i] && guava_string_is_arena(*strs[i])) {
+      *strs[i] = guava_string_new_size(*strs[i], guava_string_len(*strs[i]));
+    }
+  }
+
+  guava_request_retain_headers(req);
+}
+
+PyObject *guava_request_headers_dict(guava_request_t *req) {
+  if (req->HEADERS) {
+    return req->HEADERS;
+  }
+
+  req->HEADERS = PyDict_New();
+  if (!req->HEADERS) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < req->nheaders; ++i) {
+    guava_request_header_t *header = &req->headers[i];
+    PyObject *key = PyString_FromStringAndSize(guava_slice_ptr(req, &header->name), header->name.len);
+    PyObject *value = PyString_FromStringAndSize(guava_slice_ptr(req, &header->value), header->value.len);
+    if (key && value) {
+      PyDict_SetItem(req->HEADERS, key, value);
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+  }
+
+  return req->HEADERS;
+}
+
+static guava_bool_t guava_request_media_type_is(const char *content_type, size_t len, const char *media_type) {
+  size_t media_type_len = strlen(media_type);
+
+  if (len < media_type_len || strncasecmp(content_type, media_type, media_type_len) != 0) {
+    return GUAVA_FALSE;
+  }
+
+  /* Parameters like charset may follow */
+  return len == media_type_len || content_type[media_type_len] == ';' || content_type[media_type_len] == ' ';
+}
+
+static void guava_request_reject(guava_conn_t *conn, void (*render)(guava_response_t *, void *));
+
 int guava_request_on_headers_complete(http_parser *parser) {
   guava_conn_t *conn = (guava_conn_t *)parser->data;
   Request *request = (Request *)conn->request;
@@ -266,80 +434,108 @@ int guava_request_on_headers_complete(http_parser *parser) {
 
   conn->keep_alive = request->req->keep_alive;
 
-  conn->auxiliary_current_header = NULL;
   conn->auxiliary_last_was_header = 0;
+  conn->in_body = 1;
+
+  guava_conn_set_timeout(conn, conn->server->body_timeout);
 
-  PyObject *host = PyDict_GetItemString(request->req->HEADERS, "Host");
+  guava_request_extract_from_url(request->req);
+
+  size_t max_body_size = conn->server->max_body_size;
+  if (max_body_size && parser->content_length != ULLONG_MAX && parser->content_length > max_body_size) {
+    guava_request_reject(conn, guava_response_413);
+    return -1;
+  }
+
+  size_t len = 0;
+  const char *host = guava_request_get_header(request->req, "Host", &len);
   if (host) {
-    request->req->host = guava_string_new(PyString_AsString(host));
+    request->req->host = guava_string_arena_new_size(request->req->arena, host, len);
   }
 
-  PyObject *cookie = PyDict_GetItemString(request->req->HEADERS, "Cookie");
+  const char *cookie = guava_request_get_header(request->req, "Cookie", &len);
   if (cookie) {
-    char *p = PyString_AsString(cookie);
+    guava_string_t s = guava_string_arena_new_size(request->req->arena, cookie, len);
+    char *p = s;
     char **data = (char **)&p;
     Cookie *c = NULL;
 
     while ((c = (Cookie *)guava_cookie_parse(data))) {
       PyDict_SetItemString(request->req->COOKIES, c->data.name, (PyObject *)c);
+      Py_DECREF(c);
+    }
+    guava_string_free(s);
+  }
+
+  /* The body parser is chosen once, the chunks are parsed as they arrive */
+  const char *content_type = guava_request_get_header(request->req, "Content-Type", &len);
+  if (content_type && guava_request_media_type_is(content_type, len, "application/x-www-form-urlencoded")) {
+    request->req->body_type = GUAVA_REQUEST_BODY_URLENCODED;
+  } else if (content_type && guava_request_media_type_is(content_type, len, "multipart/form-data")) {
+    guava_string_t boundary = NULL;
+    if (guava_multipart_boundary(content_type, len, &boundary)) {
+      request->req->body_type = GUAVA_REQUEST_BODY_MULTIPART;
+      request->req->FILES = PyDict_New();
+      guava_multipart_parser_init(&request->req->multipart, boundary, conn->server->upload_spill_size);
     }
   }
 
   return 0;
 }
 
+static void guava_request_reject(guava_conn_t *conn, void (*render)(guava_response_t *, void *)) {
+  Request *request = (Request *)conn->request;
+  guava_response_t *resp = guava_response_new(&conn->server->responses);
+
+  /* Answer right away and drop the connection, the rest of the request is never read */
+  request->req->keep_alive = 0;
+  conn->keep_alive = 0;
+
+  guava_response_set_conn(resp, conn);
+  render(resp, NULL);
+  guava_response_send(resp);
+
+  uv_read_stop((uv_stream_t *)&conn->stream);
+  Py_CLEAR(conn->request);
+}
+
 int guava_request_on_body(http_parser *parser, const char *buf, size_t len) {
   guava_conn_t *conn = (guava_conn_t *)parser->data;
-  Request *request = (Request *)conn->request;
-  if (len) {
-    request->req->body = guava_string_append_raw_size(request->req->body, buf, len);
-
-    PyObject *content_type = PyDict_GetItemString(request->req->HEADERS, "Content-Type");
-    if (content_type) {
-      char *form_data = request->req->body;
-      char **p = &form_data;
-      if (strcmp(PyString_AsString(content_type), "application/x-www-form-urlencoded") == 0) {
-        guava_string_t name = NULL;
-        guava_string_t value = NULL;
-
-        while (guava_request_parse_form_data(p, &name, &value)) {
-          PyObject *s = PyString_FromString(value);
-          PyDict_SetItemString(request->req->POST, name, s);
-          Py_DECREF(s);
-
-          name = NULL;
-          value = NULL;
-        }
+  guava_request_t *req = ((Request *)conn->request)->req;
+  size_t max_body_size = conn->server->max_body_size;
 
-        if (name) {
-          guava_string_free(name);
-        }
-        if (value) {
-          guava_string_free(value);
-        }
+  guava_conn_set_timeout(conn, conn->server->body_timeout);
 
-      }
-    }
+  if (!len) {
+    return 0;
   }
 
-  return 0;
-}
+  req->body_size += len;
+  if (max_body_size && req->body_size > max_body_size) {
+    guava_request_reject(conn, guava_response_413);
+    return -1;
+  }
+
+  if (req->body_type == GUAVA_REQUEST_BODY_MULTIPART) {
+    /* Uploads are not kept in the body, big files go straight to disk */
+    guava_multipart_parser_execute(&req->multipart, buf, len, req->POST, req->FILES);
 
-void on_write(uv_write_t *req, int status) {
-  guava_response_t *resp = (guava_response_t *)req->data;
-  guava_conn_t *conn = resp->conn;
-  guava_response_free(resp);
-  if (!uv_is_closing((uv_handle_t *)&conn->stream)) {
-    if (!conn->keep_alive) {
-      uv_close((uv_handle_t *)&conn->stream, guava_server_on_close);
+    /* A broken body or an upload which could not be stored is not handed to the application */
+    int status = guava_multipart_parser_status(&req->multipart);
+    if (status) {
+      guava_request_reject(conn, status == 500 ? guava_response_500 : guava_response_400);
+      return -1;
     }
+    return 0;
   }
-}
 
-void on_sendfile(uv_fs_t *req) {
-  if (req->result < 0) {
-    fprintf(stderr, "sendfile error: %s\n", uv_strerror((int)req->result));
+  guava_strbuf_append(&req->body_buf, buf, len);
+
+  if (req->body_type == GUAVA_REQUEST_BODY_URLENCODED) {
+    guava_form_parser_execute(&req->form, buf, len, req->POST);
   }
+
+  return 0;
 }
 
 int guava_request_on_message_complete(http_parser *parser) {
@@ -347,138 +543,112 @@ int guava_request_on_message_complete(http_parser *parser) {
   Request *request = (Request *)conn->request;
   guava_server_t *server = conn->server;
 
-  Router *router = NULL;
   Handler *handler = NULL;
 
-  guava_response_t *resp = guava_response_new();
-  guava_response_set_conn(resp, conn);
-
-  Py_ssize_t nrouters = PyList_Size(server->routers);
+  if (request->req->body_buf.len) {
+    request->req->body = guava_strbuf_to_string(&request->req->body_buf);
+  }
 
-  do {
-    router = (Router *)guava_router_get_best_matched_router((PyObject *)server->routers, (PyObject *)request);
-    if (router) {
-      handler = (Handler *)PyObject_CallMethod((PyObject *)router, "route", "(O)", request);
-      handler->handler->router = router->router;
-    }
+  if (request->req->body_type == GUAVA_REQUEST_BODY_URLENCODED) {
+    guava_form_parser_finish(&request->req->form, request->req->POST);
+  } else if (request->req->body_type == GUAVA_REQUEST_BODY_MULTIPART) {
+    guava_multipart_parser_finish(&request->req->multipart);
+  }
 
-    for (Py_ssize_t i = 0; i < nrouters; ++i) {
-      router = (Router *)PyList_GetItem(server->routers, i);
-      if (router->router->type != GUAVA_ROUTER_CUSTOM) {
-        /*
-         * Cause we already try to get the best matched router
-         * But we still need to pass the custome router in case use defined some speciall routes
-         */
-        continue;
-      }
-      Handler *h = (Handler *)PyObject_CallMethod((PyObject *)router, "route", "(O)", request);
-      if ((PyObject *)h != Py_None) {
-        handler = h;
-        handler->handler->router = router->router;
-        break;
-      }
-    }
+  guava_response_t *resp = guava_response_new(&server->responses);
+  guava_response_set_conn(resp, conn);
 
-    assert(handler != NULL);
-    assert(handler->handler != NULL);
+  do {
+    handler = (Handler *)guava_router_route(server, (PyObject *)request);
 
     if (!handler ||
         !handler->handler ||
         !guava_handler_is_valid(handler->handler) ||
         handler->handler->flags & GUAVA_HANDLER_404) {
       guava_response_404(resp, NULL);
-      guava_response_send(resp, on_write);
+      guava_response_send(resp);
       break;
     }
 
     if (handler->handler->flags & GUAVA_HANDLER_REDIRECT) {
       PyObject *location = PyTuple_GetItem(handler->handler->args, 0);
       guava_response_302(resp, PyString_AsString(location));
-      guava_response_send(resp, on_write);
+      guava_response_send(resp);
       break;
     }
 
     if (handler->handler->router->type == GUAVA_ROUTER_STATIC) {
-      guava_handler_static(handler->handler->router, conn, ((Request *)conn->request)->req, resp, on_write, on_sendfile);
+      guava_handler_static(handler->handler->router, conn, ((Request *)conn->request)->req, resp);
       break;
     }
 
-    PyObject *module_name = NULL;
-    if (guava_string_equal_raw(handler->handler->package, ".")) {
-      module_name = PyString_FromString(handler->handler->module);
-    } else {
-      module_name = PyString_FromFormat("%s.%s", handler->handler->package, handler->handler->module);
-    }
-
-    PyObject *module = PyImport_Import(module_name);
-    Py_DECREF(module_name);
-
-    if (!module) {
-      fprintf(stderr, "no module named: %s\n", PyString_AsString(module_name));
+    guava_dispatch_entry_t *entry = guava_dispatch_lookup(handler->handler);
+    if (!entry) {
       if (PyErr_Occurred()) {
         PyErr_Print();
       }
       guava_response_500(resp, NULL);
-      guava_response_send(resp, on_write);
+      guava_response_send(resp);
       break;
     }
 
-    PyObject *cls_name = PyString_FromString(handler->handler->cls);
-    PyObject *cls = PyObject_GetAttr(module, cls_name);
-
-    Py_DECREF(module);
-    Py_DECREF(cls_name);
+    Controller *c = (Controller *)PyObject_CallObject(entry->cls_object, NULL);
 
-    if (!cls) {
-      fprintf(stderr, "no cls named: %s\n", PyString_AsString(cls_name));
+    if (!c || !PyObject_TypeCheck(c, &ControllerType)) {
       if (PyErr_Occurred()) {
         PyErr_Print();
+      } else {
+        fprintf(stderr, "You controller class must inherit from guava.controller.Controller\n");
       }
+      Py_XDECREF(c);
       guava_response_500(resp, NULL);
-      guava_response_send(resp, on_write);
-      break;
-    }
-
-    Controller *c = (Controller *)PyObject_CallObject(cls, NULL);
-
-    if (!PyObject_TypeCheck(c, &ControllerType)) {
-      fprintf(stderr, "You controller class must inherit from guava.controller.Controller\n");
-      guava_response_500(resp, NULL);
-      guava_response_send(resp, on_write);
+      guava_response_send(resp);
       break;
     }
 
-    Py_DECREF(cls);
     c->resp = resp;
     c->req = ((Request *)conn->request)->req;
     c->router = handler->handler->router;
 
+    /* The actions may invalidate the cache, keep the name alive */
+    PyObject *action_name = entry->action_name;
+    Py_INCREF(action_name);
+
     PyObject *r = NULL;
 
     do {
 
-      r = PyObject_CallMethod((PyObject *)c, "before_action", NULL);
+      r = PyObject_CallMethodObjArgs((PyObject *)c, guava_dispatch_before_action_name(), NULL);
       if (!r) {
         goto process_500;
       }
+      Py_DECREF(r);
       /* @todo: check we could stop here in advance */
 
+      PyObject *action = PyObject_GetAttr((PyObject *)c, action_name);
+      if (!action) {
+        goto process_500;
+      }
+
       if (handler->handler->args) {
-        r = PyObject_CallMethod((PyObject *)c, handler->handler->action, "O", handler->handler->args);
+        r = PyObject_Call(action, handler->handler->args, NULL);
       } else {
-        r = PyObject_CallMethod((PyObject *)c, handler->handler->action, NULL);
+        r = PyObject_CallObject(action, NULL);
       }
+      Py_DECREF(action);
 
       if (!r) {
         goto process_500;
       }
+      Py_DECREF(r);
 
       /* @todo: check whether we could stop here */
 
-      r = PyObject_CallMethod((PyObject *)c, "after_action", NULL);
+      r = PyObject_CallMethodObjArgs((PyObject *)c, guava_dispatch_after_action_name(), NULL);
       if (!r) {
         goto process_500;
       }
+      Py_DECREF(r);
 
     } while (0);
 
@@ -505,76 +675,23 @@ int guava_request_on_message_complete(http_parser *parser) {
     guava_response_500(resp, NULL);
 
   send:
+    Py_DECREF(action_name);
     Py_DECREF(c);
-    guava_response_send(resp, on_write);
+    guava_response_send(resp);
   } while(0);
 
   Py_XDECREF(handler);
-  Py_XDECREF(conn->request);
 
-  return 0;
-}
-
-char *guava_request_parse_form_data(char **data, guava_string_t *name, guava_string_t *value) {
-  if (!data || *data == '\0') {
-    return NULL;
+  if (Py_REFCNT(conn->request) > 1) {
+    /* The request is kept by the application, it must not point into the read buffer or the arena */
+    guava_request_retain(request->req);
   }
+  Py_CLEAR(conn->request);
 
-  char *p = *data;
-
-  char *name_start = NULL;
-  char *name_end = NULL;
-  char *value_start = NULL;
-  char *value_end = NULL;
-
-  while(isspace(*p)) {
-    ++p;
+  guava_arena_reset(&conn->arena);
+  if (conn->arena.high_water > server->arena_high_water) {
+    server->arena_high_water = conn->arena.high_water;
   }
 
-  do {
-    if (*p == '\0') {
-      break;
-    }
-
-    name_start = p;
-
-    while (*p != '=') {
-      ++p;
-    }
-
-    if (*p != '=') {
-      break;
-    }
-
-    name_end = p++;
-
-    if (*p == '\0') {
-      break;
-    }
-
-    value_start = p;
-
-    while (*p != '&' && *p != '\0') {
-      ++p;
-    }
-
-    value_end = p;
-
-    if (*p == '&') {
-      ++p;
-    }
-
-    *data = p;
-  } while(0);
-
-  if (!name_start || !name_end || !value_start || !value_end) {
-    return NULL;
-  }
-
-  *name = guava_string_new_size(name_start, name_end - name_start);
-  guava_string_t v = guava_string_new_size(value_start, value_end - value_start);
-  *value = guava_url_decode(v);
-  guava_string_free(v);
-
-  return *data;
+  return 0;
 }
@@ -6,8 +6,14 @@
 
 #include "guava_response.h"
 #include "guava_string.h"
+#include "guava_strbuf.h"
 #include "guava_module.h"
 #include "guava_memory.h"
+#include "guava_slab.h"
+#include "guava_conn.h"
+#include "guava_header.h"
+#include "guava_cookie.h"
+#include "guava_file_cache.h"
 
 static guava_status_code_t guava_status_codes[] = {
   {100, "Continue"},
@@ -90,43 +96,110 @@ static guava_status_code_t guava_status_codes[] = {
   {520, "Origin Error"}
 };
 
-guava_response_t *guava_response_new(void) {
-  guava_response_t *resp = (guava_response_t *)guava_malloc(sizeof(guava_response_t));
+guava_response_t *guava_response_new(guava_slab_t *slab) {
+  guava_response_t *resp = NULL;
+
+  if (slab) {
+    resp = (guava_response_t *)guava_slab_alloc(slab);
+  } else {
+    resp = (guava_response_t *)guava_malloc(sizeof(guava_response_t));
+  }
+
   if (!resp) {
     return NULL;
   }
 
+  resp->slab = slab;
+  resp->conn = NULL;
+  resp->next = NULL;
+  resp->keep_alive = 0;
+  resp->parked = 0;
+  resp->file = -1;
+  resp->cached_file = NULL;
+  resp->raw_headers = NULL;
+  resp->raw_headers_len = 0;
+  resp->parts = resp->inline_parts;
+  resp->nparts = 0;
+  resp->parts_size = GUAVA_RESPONSE_INLINE_PARTS;
+  resp->part = 0;
+  guava_strbuf_init(&resp->tails);
+  resp->file_offset = 0;
+  resp->file_size = 0;
+
   resp->major = 1;
   resp->minor = 1;
   resp->status_code = 200;
-  resp->data = NULL;
-  resp->headers = PyDict_New();
-  resp->serialized_data = NULL;
+  guava_headers_init(&resp->headers);
   resp->cookies = NULL;
 
-  guava_response_set_header(resp, "Server", SERVER_NAME);
+  guava_strbuf_init(&resp->header);
+  resp->header_mem = NULL;
+  resp->header_slab = NULL;
+
+  resp->segments = resp->inline_segments;
+  resp->nsegments = 0;
+  resp->segments_size = GUAVA_RESPONSE_INLINE_SEGMENTS;
+  resp->body_len = 0;
+
+  guava_headers_set_static(&resp->headers, GUAVA_HEADER_SERVER, SERVER_NAME);
 
   return resp;
 }
 
-void guava_response_free(guava_response_t *resp) {
-  if (resp->data) {
-    guava_string_free(resp->data);
+static void guava_response_free_header(guava_response_t *resp) {
+  guava_strbuf_deinit(&resp->header);
+
+  if (resp->header_mem) {
+    guava_slab_free(resp->header_slab, resp->header_mem);
+  }
+
+  resp->header_mem = NULL;
+  resp->header_slab = NULL;
+}
+
+void guava_response_clear_data(guava_response_t *resp) {
+  for (size_t i = 0; i < resp->nsegments; ++i) {
+    guava_response_segment_t *segment = &resp->segments[i];
+    guava_strbuf_deinit(&segment->str);
+    Py_XDECREF(segment->object);
   }
 
-  if (resp->headers) {
-    Py_DECREF(resp->headers);
+  resp->nsegments = 0;
+  resp->nparts = 0;
+  guava_strbuf_deinit(&resp->tails);
+  resp->body_len = 0;
+}
+
+void guava_response_free(guava_response_t *resp) {
+  guava_response_clear_data(resp);
+
+  if (resp->segments != resp->inline_segments) {
+    guava_free(resp->segments);
   }
 
-  if (resp->serialized_data) {
-    guava_string_free(resp->serialized_data);
+  if (resp->parts != resp->inline_parts) {
+    guava_free(resp->parts);
   }
 
+  guava_response_free_header(resp);
+
+  guava_headers_deinit(&resp->headers);
+
   if (resp->cookies) {
     Py_DECREF(resp->cookies);
   }
 
-  guava_free(resp);
+  if (resp->cached_file) {
+    guava_file_release(resp->cached_file);
+  } else if (resp->file >= 0 && resp->conn) {
+    guava_file_close_async(&resp->conn->server->loop, resp->file);
+  }
+
+  if (resp->slab) {
+    guava_slab_free(resp->slab, resp);
+  } else {
+    guava_free(resp);
+  }
 }
 
 void guava_response_set_conn(guava_response_t *resp, guava_conn_t *conn) {
@@ -143,9 +216,7 @@ void guava_response_set_status_code(guava_response_t *resp, uint16_t status_code
 }
 
 void guava_response_set_header(guava_response_t *resp, const char *key, const char *value) {
-  PyObject *v = PyString_FromString(value);
-  PyDict_SetItemString(resp->headers, key, v);
-  Py_DECREF(v);
+  guava_headers_set(&resp->headers, key, strlen(key), value, strlen(value));
 }
 
 void guava_response_set_cookie(guava_response_t *resp, const char *key, PyObject *value) {
@@ -156,117 +227,435 @@ void guava_response_set_cookie(guava_response_t *resp, const char *key, PyObject
   PyDict_SetItemString(resp->cookies, key, value);
 }
 
+static guava_response_segment_t *guava_response_add_segment(guava_response_t *resp) {
+  if (resp->nsegments == resp->segments_size) {
+    size_t size = resp->segments_size * 2;
+    guava_response_segment_t *segments = NULL;
+
+    if (resp->segments == resp->inline_segments) {
+      segments = (guava_response_segment_t *)guava_malloc(size * sizeof(*segments));
+      if (segments) {
+        memcpy(segments, resp->inline_segments, sizeof(resp->inline_segments));
+      }
+    } else {
+      segments = (guava_response_segment_t *)guava_realloc(resp->segments, size * sizeof(*segments));
+    }
+
+    if (!segments) {
+      return NULL;
+    }
+
+    resp->segments = segments;
+    resp->segments_size = size;
+  }
+
+  guava_response_segment_t *segment = &resp->segments[resp->nsegments++];
+  segment->base = NULL;
+  segment->len = 0;
+  segment->object = NULL;
+  guava_strbuf_init(&segment->str);
+  return segment;
+}
+
+static void guava_response_add_string(guava_response_t *resp, guava_string_t data) {
+  guava_response_segment_t *segment = guava_response_add_segment(resp);
+  if (!segment) {
+    guava_string_free(data);
+    return;
+  }
+
+  guava_strbuf_from_string(&segment->str, data);
+  segment->base = segment->str.data;
+  segment->len = segment->str.len;
+  resp->body_len += segment->len;
+}
+
 void guava_response_set_data(guava_response_t *resp, guava_string_t data) {
-  resp->data = data;
+  guava_response_clear_data(resp);
+
+  if (data) {
+    guava_response_add_string(resp, data);
+  }
+}
+
+static guava_response_part_t *guava_response_add_part(guava_response_t *resp) {
+  if (resp->nparts == resp->parts_size) {
+    size_t size = resp->parts_size * 2;
+    guava_response_part_t *parts = NULL;
+
+    if (resp->parts == resp->inline_parts) {
+      parts = (guava_response_part_t *)guava_malloc(size * sizeof(*parts));
+      if (parts) {
+        memcpy(parts, resp->inline_parts, sizeof(resp->inline_parts));
+      }
+    } else {
+      parts = (guava_response_part_t *)guava_realloc(resp->parts, size * sizeof(*parts));
+    }
+
+    if (!parts) {
+      return NULL;
+    }
+
+    resp->parts = parts;
+    resp->parts_size = size;
+  }
+
+  guava_response_part_t *part = &resp->parts[resp->nparts++];
+  part->offset = 0;
+  part->size = 0;
+  part->tail_off = resp->tails.len;
+  part->tail_len = 0;
+  return part;
+}
+
+static void guava_response_add_file_part(guava_response_t *resp, int64_t offset, size_t size) {
+  if (!size) {
+    return;
+  }
+
+  guava_response_part_t *part = guava_response_add_part(resp);
+  if (!part) {
+    return;
+  }
+
+  part->offset = offset;
+  part->size = size;
+  resp->body_len += size;
+}
+
+void guava_response_set_file(guava_response_t *resp, uv_file file, int64_t offset, size_t size) {
+  resp->file = file;
+  guava_response_add_file_part(resp, offset, size);
+}
+
+/*
+ * Takes over the caller's reference on file, which keeps its contents alive
+ * as long as the response points to them. The body is left alone.
+ */
+void guava_response_hold_file(guava_response_t *resp, guava_file_t *file) {
+  if (resp->cached_file) {
+    guava_file_release(resp->cached_file);
+  }
+
+  resp->cached_file = file;
+  resp->file = file->fd;
+}
+
+/* Appends a range of the held file to the body */
+void guava_response_write_file(guava_response_t *resp, int64_t offset, size_t size) {
+  guava_file_t *file = resp->cached_file;
+
+  if (!size) {
+    return;
+  }
+
+  if (!file->data) {
+    guava_response_add_file_part(resp, offset, size);
+    return;
+  }
+
+  guava_response_segment_t *segment = guava_response_add_segment(resp);
+  if (!segment) {
+    return;
+  }
+
+  segment->base = file->data + offset;
+  segment->len = size;
+  resp->body_len += size;
+}
+
+/* The whole file with its pre-serialized header lines */
+void guava_response_set_cached_file(guava_response_t *resp, guava_file_t *file) {
+  guava_response_clear_data(resp);
+  guava_response_hold_file(resp, file);
+
+  resp->raw_headers = file->headers;
+  resp->raw_headers_len = guava_string_len(file->headers);
+
+  guava_response_write_file(resp, 0, file->size);
+}
+
+void guava_response_write_data_size(guava_response_t *resp, const char *data, size_t len) {
+  if (!len) {
+    return;
+  }
+
+  /* Data following a file part is sent once sendfile is done with it */
+  if (resp->nparts) {
+    guava_strbuf_append(&resp->tails, data, len);
+    resp->parts[resp->nparts - 1].tail_len += len;
+    resp->body_len += len;
+    return;
+  }
+
+  /* Small writes are merged into the owned copy at the tail */
+  guava_response_segment_t *last = resp->nsegments ? &resp->segments[resp->nsegments - 1] : NULL;
+  if (last && last->str.data) {
+    guava_strbuf_append(&last->str, data, len);
+    last->base = last->str.data;
+    last->len = last->str.len;
+    resp->body_len += len;
+    return;
+  }
+
+  guava_response_segment_t *segment = guava_response_add_segment(resp);
+  if (!segment) {
+    return;
+  }
+
+  guava_strbuf_append(&segment->str, data, len);
+  segment->base = segment->str.data;
+  segment->len = segment->str.len;
+  resp->body_len += segment->len;
 }
 
 void guava_response_write_data(guava_response_t *resp, const char *data) {
   if (!data) {
     return;
   }
-  resp->data = guava_string_append_raw(resp->data, data);
+  guava_response_write_data_size(resp, data, strlen(data));
 }
 
-const char *guava_status_code_desc(int code) {
-  for (size_t i = 0; i < sizeof(guava_status_codes) / sizeof(guava_status_codes[0]); ++i) {
-    if (guava_status_codes[i].code == code) {
-      return guava_status_codes[i].desc;
+int guava_response_write_object(guava_response_t *resp, PyObject *object) {
+  PyObject *owner = NULL;
+  const char *data = NULL;
+  Py_ssize_t len = 0;
+
+  if (PyUnicode_Check(object)) {
+    owner = PyUnicode_AsUTF8String(object);
+    if (!owner) {
+      return -1;
     }
+  } else {
+    Py_INCREF(object);
+    owner = object;
   }
 
-  return NULL;
+  if (PyString_Check(owner)) {
+    data = PyString_AS_STRING(owner);
+    len = PyString_GET_SIZE(owner);
+  } else if (PyObject_AsReadBuffer(owner, (const void **)&data, &len) < 0) {
+    Py_DECREF(owner);
+    return -1;
+  }
+
+  if (len < GUAVA_RESPONSE_COPY_THRESHOLD || resp->nparts) {
+    guava_response_write_data_size(resp, data, (size_t)len);
+    Py_DECREF(owner);
+    return 0;
+  }
+
+  /* Big bodies are written straight from the Python object */
+  guava_response_segment_t *segment = guava_response_add_segment(resp);
+  if (!segment) {
+    Py_DECREF(owner);
+    PyErr_NoMemory();
+    return -1;
+  }
+
+  segment->object = owner;
+  segment->base = data;
+  segment->len = (size_t)len;
+  resp->body_len += segment->len;
+  return 0;
 }
 
-guava_string_t guava_response_serialize(guava_response_t *resp) {
-  char buf[1024];
-  snprintf(buf, sizeof(buf), "HTTP/%d.%d %d %s\r\n",
-           resp->major,
-           resp->minor,
-           resp->status_code,
-           guava_status_code_desc(resp->status_code));
+#define GUAVA_STATUS_LINE_SIZE 64
+#define GUAVA_STATUS_CODE_COUNT (sizeof(guava_status_codes) / sizeof(guava_status_codes[0]))
 
-  guava_string_t s = guava_string_append_raw(NULL, buf);
+/*
+ * Indexed by status code, the status lines are rendered for HTTP/1.0 and HTTP/1.1.
+ * They live in static storage, the leak report at exit doesn't list them.
+ */
+static const char *guava_status_code_descs[GUAVA_STATUS_CODE_MAX];
+static char guava_status_line_data[2][GUAVA_STATUS_CODE_COUNT][GUAVA_STATUS_LINE_SIZE];
+static const char *guava_status_lines[2][GUAVA_STATUS_CODE_MAX];
+static uint8_t guava_status_line_lens[2][GUAVA_STATUS_CODE_MAX];
+static guava_bool_t guava_status_lines_ready = GUAVA_FALSE;
+
+static void guava_status_lines_init(void) {
+  for (size_t i = 0; i < GUAVA_STATUS_CODE_COUNT; ++i) {
+    int code = guava_status_codes[i].code;
+    if (guava_status_code_descs[code]) {
+      continue;
+    }
 
-  PyObject *key, *value;
-  Py_ssize_t pos = 0;
-  while (PyDict_Next(resp->headers, &pos, &key, &value)) {
-    snprintf(buf, sizeof(buf), "%s: %s\r\n", PyString_AsString(key), PyString_AsString(value));
-    s = guava_string_append_raw(s, buf);
+    guava_status_code_descs[code] = guava_status_codes[i].desc;
+
+    for (int minor = 0; minor < 2; ++minor) {
+      char *line = guava_status_line_data[minor][i];
+      int len = snprintf(line, GUAVA_STATUS_LINE_SIZE, "HTTP/1.%d %d %s\r\n", minor, code, guava_status_codes[i].desc);
+      /* A description too long for the table is rendered per response */
+      if (len > 0 && len < GUAVA_STATUS_LINE_SIZE) {
+        guava_status_lines[minor][code] = line;
+        guava_status_line_lens[minor][code] = (uint8_t)len;
+      }
+    }
+  }
+
+  guava_status_lines_ready = GUAVA_TRUE;
+}
+
+const char *guava_status_code_desc(int code) {
+  if (!guava_status_lines_ready) {
+    guava_status_lines_init();
   }
 
-  PyObject *kkey = PyString_FromString("Content-Length");
-  if (!PyDict_Contains(resp->headers, kkey)) {
-    snprintf(buf, sizeof(buf), "Content-Length: %zu\r\n", resp->data ? guava_string_len(resp->data) : 0);
-    s = guava_string_append_raw(s, buf);
+  if (code < 0 || code >= GUAVA_STATUS_CODE_MAX) {
+    return NULL;
+  }
+
+  return guava_status_code_descs[code];
+}
+
+static const char *guava_status_line(uint16_t major, uint16_t minor, uint16_t code, size_t *len) {
+  if (!guava_status_lines_ready) {
+    guava_status_lines_init();
+  }
+
+  if (major != 1 || minor > 1 || code >= GUAVA_STATUS_CODE_MAX) {
+    return NULL;
+  }
+
+  *len = guava_status_line_lens[minor][code];
+  return guava_status_lines[minor][code];
+}
+
+void guava_response_serialize(guava_response_t *resp) {
+  guava_strbuf_t *header = &resp->header;
+
+  guava_response_free_header(resp);
+
+  if (resp->conn) {
+    /* Most headers fit into one pooled buffer */
+    guava_slab_t *slab = &resp->conn->server->header_buffers;
+    resp->header_mem = (char *)guava_slab_alloc(slab);
+    if (resp->header_mem) {
+      resp->header_slab = slab;
+      guava_strbuf_init_borrowed(header, resp->header_mem, slab->size);
+    }
   }
-  Py_DECREF(kkey);
 
-  kkey = PyString_FromString("Set-Cookie");
-  if (!PyDict_Contains(resp->headers, kkey) && resp->cookies) {
+  size_t status_line_len = 0;
+  const char *status_line = guava_status_line(resp->major, resp->minor, resp->status_code, &status_line_len);
+  if (status_line) {
+    guava_strbuf_append(header, status_line, status_line_len);
+  } else {
+    const char *desc = guava_status_code_desc(resp->status_code);
+    guava_strbuf_append_fmt(header, "HTTP/%d.%d %d %s\r\n",
+                            resp->major,
+                            resp->minor,
+                            resp->status_code,
+                            desc ? desc : "");
+  }
+
+  if (resp->conn && !guava_headers_get_known(&resp->headers, GUAVA_HEADER_DATE)) {
+    guava_server_t *server = resp->conn->server;
+    guava_strbuf_append(header, server->date, server->date_len);
+  }
+
+  for (size_t i = 0; i < resp->headers.nentries; ++i) {
+    guava_header_t *h = &resp->headers.entries[i];
+    guava_strbuf_append(header, h->name, h->name_len);
+    guava_strbuf_append(header, ": ", 2);
+    guava_strbuf_append(header, h->value, h->value_len);
+    guava_strbuf_append(header, "\r\n", 2);
+  }
+
+  if (resp->raw_headers) {
+    guava_strbuf_append(header, resp->raw_headers, resp->raw_headers_len);
+  } else if (resp->status_code != 304 && !guava_headers_get_known(&resp->headers, GUAVA_HEADER_CONTENT_LENGTH)) {
+    guava_strbuf_append_raw(header, "Content-Length: ");
+    guava_strbuf_append_uint(header, resp->body_len);
+    guava_strbuf_append(header, "\r\n", 2);
+  }
+
+  if (!guava_headers_get_known(&resp->headers, GUAVA_HEADER_SET_COOKIE) && resp->cookies) {
     PyObject *cookie_key = NULL;
     PyObject *cookie_value = NULL;
-    Cookie *cookie = NULL;
     Py_ssize_t cookie_pos = 0;
     while (PyDict_Next(resp->cookies, &cookie_pos, &cookie_key, &cookie_value)) {
-      cookie = (Cookie *)cookie_value;
-      s = guava_string_append_raw(s, "Set-Cookie: ");
-      s = guava_string_append_raw(s, cookie->data.name);
-      s = guava_string_append_raw(s, "=");
-      s = guava_string_append_raw(s, cookie->data.value);
-      if (cookie->data.domain) {
-        s = guava_string_append_raw(s, " ;Domain=");
-        s = guava_string_append_raw(s, cookie->data.domain);
-      }
-      if (cookie->data.path) {
-        s = guava_string_append_raw(s, " ;Path=");
-        s = guava_string_append_raw(s, cookie->data.path);
-      }
-      if (cookie->data.expired >= 0) {
-        s = guava_string_append_raw(s, " ;Expires=");
-        s = guava_string_append_int(s, cookie->data.expired);
-      }
-      if (cookie->data.max_age >= 0) {
-        s = guava_string_append_raw(s, " ;Max-Age=");
-        s = guava_string_append_int(s, cookie->data.max_age);
-      }
-      if (cookie->data.secure) {
-        s = guava_string_append_raw(s, " ;Secure");
-      }
-      if (cookie->data.httponly) {
-        s = guava_string_append_raw(s, " ;HttpOnly");
-      }
-      s = guava_string_append_raw(s, "\r\n");
+      guava_strbuf_append_raw(header, "Set-Cookie: ");
+      guava_cookie_render(&((Cookie *)cookie_value)->data, header);
+      guava_strbuf_append(header, "\r\n", 2);
     }
   }
-  Py_DECREF(kkey);
 
-  s = guava_string_append_raw(s, "\r\n");
+  guava_strbuf_append(header, "\r\n", 2);
+}
+
+size_t guava_response_nbufs(guava_response_t *resp) {
+  return resp->nsegments + 1;
+}
+
+size_t guava_response_bufs(guava_response_t *resp, uv_buf_t *bufs) {
+  size_t n = 0;
+
+  bufs[n++] = uv_buf_init(resp->header.data, (unsigned int)resp->header.len);
 
-  if (resp->data) {
-    s = guava_string_append_raw(s, resp->data);
+  for (size_t i = 0; i < resp->nsegments; ++i) {
+    bufs[n++] = uv_buf_init((char *)resp->segments[i].base, (unsigned int)resp->segments[i].len);
   }
 
-  resp->serialized_data = s;
-  return s;
+  return n;
 }
 
-void guava_response_send(guava_response_t *resp, uv_write_cb cb) {
-  Request *request = (Request *)resp->conn->request;
-  if (request->req->keep_alive) {
-    guava_response_set_header(resp, "Connection", request->req->keep_alive ? "keep-alive" : "close");
+static void guava_response_finish(guava_response_t *resp) {
+  if (resp->keep_alive) {
+    guava_headers_set_static(&resp->headers, GUAVA_HEADER_CONNECTION, "keep-alive");
+  }
+
+  /* A 304 has no body to describe */
+  if (!resp->raw_headers && resp->status_code != 304 &&
+      !guava_headers_get_known(&resp->headers, GUAVA_HEADER_CONTENT_TYPE)) {
+    guava_headers_set_static(&resp->headers, GUAVA_HEADER_CONTENT_TYPE, "text/html");
   }
 
-  PyObject *key = PyString_FromString("Content-Type");
-  if (!PyDict_Contains(resp->headers, key)) {
-    guava_response_set_header(resp, "Content-Type", "text/html");
+  guava_response_serialize(resp);
+}
+
+void guava_response_send(guava_response_t *resp) {
+  Request *request = (Request *)resp->conn->request;
+  resp->keep_alive = request->req->keep_alive;
+
+  guava_response_finish(resp);
+
+  guava_conn_queue_response(resp->conn, resp);
+}
+
+/*
+ * Takes the response's place in the queue while its body is still being
+ * prepared, later responses of the conn are held back behind it
+ */
+void guava_response_park(guava_response_t *resp) {
+  Request *request = (Request *)resp->conn->request;
+  resp->keep_alive = request->req->keep_alive;
+
+  resp->parked = 1;
+  ++resp->conn->parked;
+
+  guava_conn_queue_response(resp->conn, resp);
+}
+
+void guava_response_unpark(guava_response_t *resp) {
+  if (resp->parked) {
+    resp->parked = 0;
+    --resp->conn->parked;
   }
-  Py_DECREF(key);
+}
 
-  guava_string_t data = guava_response_serialize(resp);
-  uv_buf_t b = uv_buf_init(data, (unsigned int)guava_string_len(data));
+/* The parked response is complete, it is written with the ones queued after it */
+void guava_response_resume(guava_response_t *resp) {
+  guava_response_unpark(resp);
 
-  resp->conn->write_req.data = resp;
-  uv_write(&resp->conn->write_req, (uv_stream_t *)&resp->conn->stream, &b, 1, cb);
+  guava_response_finish(resp);
+
+  guava_conn_flush(resp->conn);
+}
+
+void guava_response_400(guava_response_t *resp, void *closure) {
+  guava_response_set_status_code(resp, 400);
+  guava_response_set_data(resp, guava_string_new("400 Bad Request!"));
 }
 
 void guava_response_404(guava_response_t *resp, void *closure) {
@@ -274,6 +663,11 @@ void guava_response_404(guava_response_t *resp, void *closure) {
   guava_response_set_data(resp, guava_string_new("404 Not Found!"));
 }
 
+void guava_response_413(guava_response_t *resp, void *closure) {
+  guava_response_set_status_code(resp, 413);
+  guava_response_set_data(resp, guava_string_new("413 Request Entity Too Large!"));
+}
+
 void guava_response_500(guava_response_t *resp, void *closure) {
   guava_response_set_status_code(resp, 500);
   guava_response_set_data(resp, guava_string_new("500 Internal Server Error!"));
@@ -5,12 +5,19 @@
  */
 
 #include "guava_router/guava_router.h"
+#include "guava_router/guava_router_tree.h"
+#include "guava_router/guava_router_cache.h"
+#include "guava_router/guava_router_template.h"
 #include "guava_string.h"
 #include "guava_request.h"
 #include "guava_response.h"
 #include "guava_module.h"
+#include "guava_handler.h"
 #include "guava_memory.h"
 
+/* Bumped on every mount point change, the compiled router trees are stale then */
+static unsigned long guava_router_generation_count = 0;
+
 guava_router_t *guava_router_new(void) {
   guava_router_t *router = (guava_router_t *)guava_calloc(1, sizeof(guava_router_t));
   if (router) {
@@ -24,14 +31,81 @@ guava_router_t *guava_router_new(void) {
   return router;
 }
 
+static void guava_router_templates_clear(guava_router_t *router) {
+  guava_router_template_free(router->templates);
+  router->templates = NULL;
+  Py_CLEAR(router->templates_items);
+}
+
+/*
+ * The routes dict is handed out and changed in place, even a handler swapped
+ * for another keeps its size. The routes are compared item by item, in dict
+ * order, with the ones the templates were compiled from.
+ */
+static guava_bool_t guava_router_templates_stale(guava_router_t *router) {
+  if (!router->templates_items) {
+    return GUAVA_TRUE;
+  }
+
+  Py_ssize_t n = PyTuple_GET_SIZE(router->templates_items);
+  if (PyDict_Size(router->routes) * 2 != n) {
+    return GUAVA_TRUE;
+  }
+
+  PyObject *key = NULL, *value = NULL;
+  Py_ssize_t pos = 0;
+  for (Py_ssize_t i = 0; PyDict_Next(router->routes, &pos, &key, &value); i += 2) {
+    if (PyTuple_GET_ITEM(router->templates_items, i) != key ||
+        PyTuple_GET_ITEM(router->templates_items, i + 1) != value) {
+      return GUAVA_TRUE;
+    }
+  }
+
+  return GUAVA_FALSE;
+}
+
+static void guava_router_templates_compile(guava_router_t *router) {
+  guava_router_templates_clear(router);
+
+  PyObject *items = PyTuple_New(PyDict_Size(router->routes) * 2);
+  if (!items) {
+    PyErr_Clear();
+    return;
+  }
+
+  PyObject *key = NULL, *value = NULL;
+  Py_ssize_t pos = 0;
+  for (Py_ssize_t i = 0; PyDict_Next(router->routes, &pos, &key, &value); i += 2) {
+    Py_INCREF(key);
+    Py_INCREF(value);
+    PyTuple_SET_ITEM(items, i, key);
+    PyTuple_SET_ITEM(items, i + 1, value);
+  }
+
+  router->templates = guava_router_template_compile(router->routes);
+  router->templates_items = items;
+}
+
 void guava_router_free(guava_router_t *router) {
   if (!router) {
     return;
   }
 
+  if (router->mount_point) {
+    guava_string_free(router->mount_point);
+  }
+
+  if (router->package) {
+    guava_string_free(router->package);
+  }
+
   if (router->routes) {
     Py_DECREF(router->routes);
   }
+
+  guava_router_templates_clear(router);
+
+  guava_free(router);
 }
 
 void guava_router_set_mount_point(guava_router_t *router, const char *mount_point) {
@@ -43,17 +117,31 @@ void guava_router_set_mount_point(guava_router_t *router, const char *mount_poin
     guava_string_free(router->mount_point);
   }
 
+  /* Resolved handlers are relative to the old mount point */
+  guava_router_cache_clear(router->cache);
+  ++guava_router_generation_count;
+
   router->mount_point = guava_string_new(mount_point);
   if (router->mount_point[guava_string_len(router->mount_point)-1] != '/') {
     router->mount_point = guava_string_append_raw(router->mount_point, "/");
   }
 }
 
+unsigned long guava_router_generation(void) {
+  return guava_router_generation_count;
+}
+
 void guava_router_set_package(guava_router_t *router, const char *package) {
   if (!router || !package) {
     return;
   }
 
+  if (router->package) {
+    guava_string_free(router->package);
+  }
+
+  guava_router_cache_clear(router->cache);
+
   router->package = guava_string_new(package);
 }
 
@@ -70,40 +158,202 @@ void guava_router_set_routes(guava_router_t *router, PyObject *routes) {
     return;
   }
 
+  Py_XDECREF(router->routes);
   router->routes = routes;
+
+  guava_router_templates_clear(router);
 }
 
-PyObject *guava_router_get_best_matched_router(PyObject *routers, PyObject *request) {
-  /* @todo: Optimize this algorithm */
-  Router *router = NULL;
-  Py_ssize_t size = PyList_Size(routers);
-  guava_string_t path = ((Request *)request)->req->url;
-  size_t path_len = guava_string_len(path);
-  char c[1024];
-
-  for (size_t i = path_len; i > 0; --i) {
-    if (path[i-1] == '/' || i == path_len) {
-      memcpy(c, path, i);
-      c[i] = '\0';
-      for (Py_ssize_t j = 0; j < size; ++j) {
-        Router *r = (Router *)PyList_GetItem(routers, j);
-        if (r->router->type == GUAVA_ROUTER_CUSTOM) { /* Skip all custom routers */
-          continue;
-        }
-
-        if (strcmp(r->router->mount_point, c) == 0) {
-          /* We found the best matched router */
-          router = r;
-          goto result;
-        }
-
-      }
-    } else {
-      continue;
+PyObject *guava_router_custom_route(guava_router_t *router, guava_request_t *req) {
+  if (!router->routes || !req->path) {
+    return NULL;
+  }
+
+  PyObject *handler = PyDict_GetItemString(router->routes, req->path);
+  if (handler) {
+    Py_INCREF(handler);
+    return handler;
+  }
+
+  /* Compiled on the first miss, and again whenever routes were added, removed or replaced */
+  if (guava_router_templates_stale(router)) {
+    guava_router_templates_compile(router);
+  }
+
+  if (!router->templates) {
+    return NULL;
+  }
+
+  PyObject *args = NULL;
+  handler = guava_router_template_match(router->templates, req->path, guava_string_len(req->path), &args);
+  if (!handler) {
+    return NULL;
+  }
+
+  /* The registered handler is shared, the captured params go to a copy of it */
+  if (!args || Py_TYPE(handler) != &HandlerType) {
+    Py_XDECREF(args);
+    Py_INCREF(handler);
+    return handler;
+  }
+
+  Handler *h = (Handler *)Handler_new(&HandlerType, NULL, NULL);
+  if (!h) {
+    Py_DECREF(args);
+    return NULL;
+  }
+
+  guava_handler_copy(((Handler *)handler)->handler, h->handler);
+  Py_XDECREF(h->handler->args);
+  h->handler->args = args;
+
+  return (PyObject *)h;
+}
+
+PyObject *guava_router_get_best_matched_router(guava_server_t *server, PyObject *request) {
+  Py_ssize_t size = PyList_Size(server->routers);
+  unsigned long generation = guava_router_generation();
+
+  /* Compiled on the first request, and again whenever routers were added or moved */
+  if (!server->router_tree || server->router_tree_size != size || server->router_tree_generation != generation) {
+    guava_router_tree_free(server->router_tree);
+    server->router_tree = guava_router_tree_compile(server->routers);
+    server->router_tree_size = size;
+    server->router_tree_generation = generation;
+  }
+
+  if (!server->router_tree) {
+    return NULL;
+  }
+
+  guava_request_t *req = ((Request *)request)->req;
+  guava_string_t path = req->path ? req->path : req->url;
+  if (!path) {
+    return NULL;
+  }
+
+  return guava_router_tree_match(server->router_tree, path, guava_string_len(path));
+}
+
+PyObject *guava_router_native_route(guava_router_t *router, guava_request_t *req) {
+  if (router->type == GUAVA_ROUTER_CUSTOM) {
+    return guava_router_custom_route(router, req);
+  }
+
+  guava_handler_t *handler = guava_handler_new();
+  PyTypeObject *type = &HandlerType;
+
+  switch (router->type) {
+  case GUAVA_ROUTER_MVC:
+    guava_router_mvc_route((guava_router_mvc_t *)router, req, handler);
+    break;
+
+  case GUAVA_ROUTER_REST:
+    guava_router_rest_route((guava_router_rest_t *)router, req, handler);
+    break;
+
+  case GUAVA_ROUTER_STATIC:
+    guava_router_static_route((guava_router_static_t *)router, req, handler);
+    type = &StaticHandlerType;
+    break;
+
+  default:
+    break;
+  }
+
+  if (!guava_handler_is_valid(handler)) {
+    guava_handler_free(handler);
+    return NULL;
+  }
+
+  Handler *handler_obj = PyObject_New(Handler, type);
+  handler_obj->handler = handler;
+
+  return (PyObject *)handler_obj;
+}
+
+static guava_bool_t guava_router_overrides_route(PyObject *router) {
+  static PyObject *route_name = NULL;
+  if (!route_name) {
+    route_name = PyString_InternFromString("route");
+  }
+
+  PyObject **dict = _PyObject_GetDictPtr(router);
+  if (dict && *dict && PyDict_GetItem(*dict, route_name)) {
+    return GUAVA_TRUE;
+  }
+
+  /* Python subclasses override route unless it still resolves to the builtin one */
+  PyTypeObject *builtin = Py_TYPE(router);
+  while (builtin->tp_flags & Py_TPFLAGS_HEAPTYPE) {
+    builtin = builtin->tp_base;
+  }
+
+  return _PyType_Lookup(Py_TYPE(router), route_name) != _PyType_Lookup(builtin, route_name) ? GUAVA_TRUE : GUAVA_FALSE;
+}
+
+/* The handler types share their layout, the router is set through any of them */
+static guava_bool_t guava_router_is_handler(PyObject *handler) {
+  return PyObject_TypeCheck(handler, &HandlerType) ||
+         PyObject_TypeCheck(handler, &StaticHandlerType) ||
+         PyObject_TypeCheck(handler, &RedirectHandlerType);
+}
+
+static PyObject *guava_router_route_one(PyObject *router, PyObject *request) {
+  PyObject *handler = NULL;
+
+  if (guava_router_overrides_route(router)) {
+    handler = PyObject_CallMethod(router, "route", "(O)", request);
+    if (!handler) {
+      PyErr_Print();
+      return NULL;
+    }
+
+    if (handler == Py_None) {
+      Py_DECREF(handler);
+      return NULL;
+    }
+
+    if (!guava_router_is_handler(handler)) {
+      fprintf(stderr, "%s.route() returned a %s instead of a handler\n",
+              Py_TYPE(router)->tp_name, Py_TYPE(handler)->tp_name);
+      Py_DECREF(handler);
+      return NULL;
+    }
+  } else {
+    handler = guava_router_native_route(((Router *)router)->router, ((Request *)request)->req);
+    if (!handler) {
+      return NULL;
     }
   }
 
- result:
+  ((Handler *)handler)->handler->router = ((Router *)router)->router;
+  return handler;
+}
+
+PyObject *guava_router_route(guava_server_t *server, PyObject *request) {
+  PyObject *handler = NULL;
+
+  PyObject *router = guava_router_get_best_matched_router(server, request);
+  if (router) {
+    handler = guava_router_route_one(router, request);
+  }
+
+  /* Custom routers are not mounted, they may still override the best matched one */
+  Py_ssize_t nrouters = PyList_Size(server->routers);
+  for (Py_ssize_t i = 0; i < nrouters; ++i) {
+    router = PyList_GetItem(server->routers, i);
+    if (((Router *)router)->router->type != GUAVA_ROUTER_CUSTOM) {
+      continue;
+    }
+
+    PyObject *h = guava_router_route_one(router, request);
+    if (h) {
+      Py_XDECREF(handler);
+      handler = h;
+      break;
+    }
+  }
 
-  return (PyObject *)router;
+  return handler;
 }
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_router/guava_router_cache.h"
+#include "guava_handler.h"
+#include "guava_string.h"
+#include "guava_memory.h"
+
+static uint32_t guava_router_cache_hash(int method, const char *key, size_t len) {
+  uint32_t h = 2166136261u ^ (uint32_t)method;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)key[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+guava_router_cache_t *guava_router_cache_new(size_t capacity) {
+  guava_router_cache_t *cache = (guava_router_cache_t *)guava_calloc(1, sizeof(guava_router_cache_t));
+  if (!cache) {
+    return NULL;
+  }
+
+  cache->nbuckets = 16;
+  while (cache->nbuckets < capacity) {
+    cache->nbuckets <<= 1;
+  }
+
+  cache->buckets = (guava_router_cache_entry_t **)guava_calloc(cache->nbuckets, sizeof(guava_router_cache_entry_t *));
+  if (!cache->buckets) {
+    guava_free(cache);
+    return NULL;
+  }
+
+  cache->capacity = capacity;
+  return cache;
+}
+
+static void guava_router_cache_unlink(guava_router_cache_t *cache, guava_router_cache_entry_t *entry) {
+  if (entry->prev) {
+    entry->prev->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+
+  if (entry->next) {
+    entry->next->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+
+  entry->prev = entry->next = NULL;
+}
+
+static void guava_router_cache_push_front(guava_router_cache_t *cache, guava_router_cache_entry_t *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head) {
+    cache->head->prev = entry;
+  } else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+}
+
+static void guava_router_cache_entry_free(guava_router_cache_entry_t *entry) {
+  guava_handler_deinit(&entry->handler);
+  guava_string_free(entry->key);
+  guava_free(entry);
+}
+
+static void guava_router_cache_remove(guava_router_cache_t *cache, guava_router_cache_entry_t *entry) {
+  guava_router_cache_entry_t **p = &cache->buckets[entry->hash & (cache->nbuckets - 1)];
+  while (*p != entry) {
+    p = &(*p)->hnext;
+  }
+  *p = entry->hnext;
+
+  guava_router_cache_unlink(cache, entry);
+  guava_router_cache_entry_free(entry);
+  --cache->count;
+}
+
+void guava_router_cache_clear(guava_router_cache_t *cache) {
+  if (!cache) {
+    return;
+  }
+
+  guava_router_cache_entry_t *entry = cache->head;
+  while (entry) {
+    guava_router_cache_entry_t *next = entry->next;
+    guava_router_cache_entry_free(entry);
+    entry = next;
+  }
+
+  memset(cache->buckets, 0, cache->nbuckets * sizeof(guava_router_cache_entry_t *));
+  cache->head = cache->tail = NULL;
+  cache->count = 0;
+}
+
+void guava_router_cache_free(guava_router_cache_t *cache) {
+  if (!cache) {
+    return;
+  }
+
+  guava_router_cache_clear(cache);
+  guava_free(cache->buckets);
+  guava_free(cache);
+}
+
+guava_handler_t *guava_router_cache_get(guava_router_cache_t *cache, int method, const char *key, size_t len) {
+  uint32_t hash = guava_router_cache_hash(method, key, len);
+  guava_router_cache_entry_t *entry = cache->buckets[hash & (cache->nbuckets - 1)];
+
+  for (; entry; entry = entry->hnext) {
+    if (entry->hash == hash &&
+        entry->method == method &&
+        guava_string_len(entry->key) == len &&
+        memcmp(entry->key, key, len) == 0) {
+      break;
+    }
+  }
+
+  if (!entry) {
+    ++cache->misses;
+    return NULL;
+  }
+
+  ++cache->hits;
+  if (entry != cache->head) {
+    guava_router_cache_unlink(cache, entry);
+    guava_router_cache_push_front(cache, entry);
+  }
+
+  return &entry->handler;
+}
+
+void guava_router_cache_put(guava_router_cache_t *cache, int method, const char *key, size_t len, guava_handler_t *handler) {
+  if (cache->capacity == 0) {
+    return;
+  }
+
+  if (cache->count >= cache->capacity) {
+    guava_router_cache_remove(cache, cache->tail);
+  }
+
+  guava_router_cache_entry_t *entry = (guava_router_cache_entry_t *)guava_calloc(1, sizeof(guava_router_cache_entry_t));
+  if (!entry) {
+    return;
+  }
+
+  entry->hash = guava_router_cache_hash(method, key, len);
+  entry->method = method;
+  entry->key = guava_string_new_size(key, len);
+
+  /* Only the resolved names are shared, args differ from request to request */
+  guava_handler_copy(handler, &entry->handler);
+  Py_CLEAR(entry->handler.args);
+  entry->handler.router = NULL;
+
+  size_t slot = entry->hash & (cache->nbuckets - 1);
+  entry->hnext = cache->buckets[slot];
+  cache->buckets[slot] = entry;
+
+  guava_router_cache_push_front(cache, entry);
+  ++cache->count;
+}
@@ -5,6 +5,7 @@
  */
 
 #include "guava_router/guava_router.h"
+#include "guava_router/guava_router_cache.h"
 #include "guava_string.h"
 #include "guava_request.h"
 #include "guava_response.h"
@@ -23,6 +24,7 @@ guava_router_mvc_t *guava_router_mvc_new(void) {
   router->route.type = GUAVA_ROUTER_MVC;
   router->route.session_store = NULL;
   router->route.routes = NULL;
+  router->route.cache = NULL;
 
   return router;
 }
@@ -48,69 +50,99 @@ void guava_router_mvc_free(guava_router_mvc_t *router) {
     Py_DECREF(router->route.routes);
   }
 
+  guava_router_cache_free(router->route.cache);
+
   guava_free(router);
 }
 
 void guava_router_mvc_route(guava_router_mvc_t *router, guava_request_t *req, guava_handler_t *handler) {
-  if (!router || !req || !handler) {
+  if (!router || !req || !handler || !req->path) {
     return;
   }
 
-  char *ptr = strstr(req->path, router->route.mount_point);
+  const char *ptr = strstr(req->path, router->route.mount_point);
   if (!ptr) {
     return;
   }
 
   ptr += guava_string_len(router->route.mount_point);
 
-  const char *sep = "/";
+  const char *end = req->path + guava_string_len(req->path);
+  const char *words[2] = {NULL, NULL};
+  size_t lens[2] = {0, 0};
+  size_t idx = 0;
+  const char *key_end = ptr;
+  PyObject *args = NULL;
 
-  char *word, *save;
+  /* module/action are the first two non-empty segments, the rest are the args */
+  const char *p = ptr;
+  while (p < end) {
+    if (*p == '/') {
+      ++p;
+      continue;
+    }
 
-  guava_string_t module = NULL;
-  guava_string_t cls = NULL;
-  guava_string_t action = NULL;
-  PyObject *args = NULL;
-  PyObject *arg = NULL;
+    const char *q = memchr(p, '/', end - p);
+    if (!q) {
+      q = end;
+    }
 
-  size_t idx = 0;
-  for (word = strtok_r(ptr, sep, &save); word; word = strtok_r(NULL, sep, &save), ++idx) {
-    if (idx == 0) {
-      module = guava_string_new(word);
-      char s[1024];
-      snprintf(s, sizeof(s), "%c%sController", toupper(word[0]), word+1);
-      cls = guava_string_new(s);
-    } else if (idx == 1) {
-      action = guava_string_new(word);
+    if (idx < 2) {
+      words[idx] = p;
+      lens[idx] = q - p;
+      key_end = q;
     } else {
-      arg = PyString_FromString(word);
+      PyObject *arg = PyString_FromStringAndSize(p, q - p);
       if (!args) {
         args = PyList_New(0);
       }
       PyList_Append(args, arg);
       Py_DECREF(arg);
     }
-  }
 
-  if (!module) {
-    module = guava_string_new("index");
+    ++idx;
+    p = q;
   }
-  if (!cls) {
-    cls = guava_string_new("IndexController");
+
+  if (!router->route.cache) {
+    router->route.cache = guava_router_cache_new(GUAVA_ROUTER_CACHE_SIZE);
   }
-  if (!action) {
-    action = guava_string_new("index");
+
+  guava_handler_t *cached = NULL;
+  if (router->route.cache) {
+    cached = guava_router_cache_get(router->route.cache, req->method, ptr, key_end - ptr);
   }
 
-  handler->package = guava_string_new(router->route.package);
-  handler->module = module;
-  handler->cls = cls;
-  handler->action = action;
+  if (cached) {
+    guava_handler_copy(cached, handler);
+  } else {
+    char s[1024];
+
+    if (words[0]) {
+      handler->module = guava_string_new_size(words[0], lens[0]);
+      snprintf(s, sizeof(s), "%c%.*sController", toupper(words[0][0]), (int)lens[0] - 1, words[0] + 1);
+      handler->cls = guava_string_new(s);
+    } else {
+      handler->module = guava_string_new("index");
+      handler->cls = guava_string_new("IndexController");
+    }
+
+    if (words[1]) {
+      handler->action = guava_string_new_size(words[1], lens[1]);
+    } else {
+      handler->action = guava_string_new("index");
+    }
+
+    handler->package = guava_string_new(router->route.package);
+    guava_handler_mark_valid(handler);
+
+    if (router->route.cache) {
+      guava_router_cache_put(router->route.cache, req->method, ptr, key_end - ptr, handler);
+    }
+  }
 
   if (args) {
     handler->args = PyList_AsTuple(args);
     Py_DECREF(args);
   }
-
-  guava_handler_mark_valid(handler);
 }
@@ -5,6 +5,7 @@
  */
 
 #include "guava_router/guava_router.h"
+#include "guava_router/guava_router_cache.h"
 #include "guava_string.h"
 #include "guava_request.h"
 #include "guava_response.h"
@@ -28,6 +29,10 @@ guava_router_rest_t *guava_router_rest_new(void) {
 }
 
 void guava_router_rest_free(guava_router_rest_t *router) {
+  if (!router) {
+    return;
+  }
+
   if (router->route.session_store) {
     guava_session_store_free(router->route.session_store);
   }
@@ -36,57 +41,27 @@ void guava_router_rest_free(guava_router_rest_t *router) {
     Py_DECREF(router->route.routes);
   }
 
-  if (router) {
-    guava_free(router);
-  }
-}
-
-void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req, guava_handler_t *handler) {
-  if (!router || !req || !handler) {
-    return;
-  }
-
-  const char *ptr = strstr(req->path, router->route.mount_point);
-  if (!ptr) {
-    return;
-  }
-
-  ptr += guava_string_len(router->route.mount_point);
-  if (!ptr) {
-    return;
-  }
-
-  /* try to split the path and get the resource */
-  const char *next_slash = strchr(ptr, '/');
-
-  guava_string_t resource = NULL;
-  guava_string_t item_id = NULL;
+  guava_router_cache_free(router->route.cache);
 
-  if (next_slash != ptr) {
-    resource = guava_string_new_size(ptr, next_slash - ptr);
-  }
-
-  ptr = next_slash + 1;
-
-  if (ptr) {
-    next_slash = strchr(ptr, '/');
-    if (next_slash) {
-      item_id = guava_string_new_size(ptr, next_slash - ptr);
-    } else if (strlen(ptr)) {
-      item_id = guava_string_new(ptr);
-    }
-  }
+  guava_free(router);
+}
 
-  handler->module = resource;
+static void guava_router_rest_resolve(guava_router_rest_t *router,
+                                      int method,
+                                      const char *resource,
+                                      size_t resource_len,
+                                      guava_bool_t has_item,
+                                      guava_handler_t *handler) {
+  handler->module = guava_string_new_size(resource, resource_len);
 
   char s[1024];
-  snprintf(s, sizeof(s), "%c%sController", toupper(resource[0]), resource+1);
+  snprintf(s, sizeof(s), "%c%.*sController", toupper(resource[0]), (int)resource_len - 1, resource + 1);
   handler->cls = guava_string_new(s);
 
-  switch(req->method) {
+  switch(method) {
   case HTTP_GET: {
     /* Get all items or one specific item */
-    if (!item_id) {
+    if (!has_item) {
       handler->action = guava_string_new("get_all");
     } else {
       handler->action = guava_string_new("get_one");
@@ -97,7 +72,7 @@ void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req,
   case HTTP_POST: {
     /* Create new item */
 
-    if (item_id) {
+    if (has_item) {
       handler->flags |= GUAVA_HANDLER_404;
       break;
     }
@@ -109,7 +84,7 @@ void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req,
 
   case HTTP_PUT: {
     /* PUT should be put to the root of resource */
-    if (!item_id) {
+    if (!has_item) {
       handler->flags |= GUAVA_HANDLER_404;
       break;
     }
@@ -119,7 +94,7 @@ void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req,
   }
 
   case HTTP_DELETE: {
-    if (!item_id) {
+    if (!has_item) {
       handler->flags |= GUAVA_HANDLER_404;
       break;
     }
@@ -139,3 +114,54 @@ void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req,
     guava_handler_mark_valid(handler);
   }
 }
+
+void guava_router_rest_route(guava_router_rest_t *router, guava_request_t *req, guava_handler_t *handler) {
+  if (!router || !req || !handler || !req->path) {
+    return;
+  }
+
+  const char *ptr = strstr(req->path, router->route.mount_point);
+  if (!ptr) {
+    return;
+  }
+
+  ptr += guava_string_len(router->route.mount_point);
+
+  /* try to split the path and get the resource */
+  const char *end = req->path + guava_string_len(req->path);
+  const char *next_slash = memchr(ptr, '/', end - ptr);
+  if (!next_slash) {
+    next_slash = end;
+  }
+
+  if (next_slash == ptr) {
+    return;
+  }
+
+  const char *resource = ptr;
+  size_t resource_len = next_slash - ptr;
+  guava_bool_t has_item = next_slash + 1 < end && next_slash[1] != '/';
+
+  /* The action only depends on the method and whether an item is addressed */
+  int key_method = (req->method << 1) | has_item;
+
+  if (!router->route.cache) {
+    router->route.cache = guava_router_cache_new(GUAVA_ROUTER_CACHE_SIZE);
+  }
+
+  guava_handler_t *cached = NULL;
+  if (router->route.cache) {
+    cached = guava_router_cache_get(router->route.cache, key_method, resource, resource_len);
+  }
+
+  if (cached) {
+    guava_handler_copy(cached, handler);
+    return;
+  }
+
+  guava_router_rest_resolve(router, req->method, resource, resource_len, has_item, handler);
+
+  if (router->route.cache) {
+    guava_router_cache_put(router->route.cache, key_method, resource, resource_len, handler);
+  }
+}
@@ -23,8 +23,13 @@ guava_router_static_t *guava_router_static_new(void) {
   router->route.type = GUAVA_ROUTER_STATIC;
   router->route.session_store = NULL;
   router->route.routes = NULL;
+  router->route.cache = NULL;
   router->directory = guava_string_new("./static");
   router->allow_index = GUAVA_FALSE;
+  router->memory_file_size = GUAVA_ROUTER_STATIC_MEMORY_FILE_SIZE;
+  router->cache_control = NULL;
+  router->gzip_static = GUAVA_FALSE;
+  router->gzip = GUAVA_FALSE;
 
   return router;
 }
@@ -54,6 +59,10 @@ void guava_router_static_free(guava_router_static_t *router) {
     guava_string_free(router->directory);
   }
 
+  if (router->cache_control) {
+    guava_string_free(router->cache_control);
+  }
+
   guava_free(router);
 }
 
@@ -77,6 +86,42 @@ void guava_router_static_set_allow_index(guava_router_static_t *router, const gu
   router->allow_index = allow_index;
 }
 
+void guava_router_static_set_memory_file_size(guava_router_static_t *router, size_t size) {
+  if (!router) {
+    return;
+  }
+
+  router->memory_file_size = size;
+}
+
+void guava_router_static_set_cache_control(guava_router_static_t *router, const char *cache_control) {
+  if (!router) {
+    return;
+  }
+
+  if (router->cache_control) {
+    guava_string_free(router->cache_control);
+  }
+
+  router->cache_control = cache_control ? guava_string_new(cache_control) : NULL;
+}
+
+void guava_router_static_set_gzip_static(guava_router_static_t *router, const guava_bool_t gzip_static) {
+  if (!router) {
+    return;
+  }
+
+  router->gzip_static = gzip_static;
+}
+
+void guava_router_static_set_gzip(guava_router_static_t *router, const guava_bool_t gzip) {
+  if (!router) {
+    return;
+  }
+
+  router->gzip = gzip;
+}
+
 void guava_router_static_route(guava_router_static_t *router, guava_request_t *req, guava_handler_t *handler) {
   if (!router || !req) {
     return;
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_router/guava_router_template.h"
+#include "guava_string.h"
+#include "guava_memory.h"
+
+/* Longest integer segment we convert, anything longer is not a match */
+#define GUAVA_ROUTER_TEMPLATE_MAX_INT_LEN 32
+
+guava_bool_t guava_router_template_is_template(const char *path) {
+  return path && strchr(path, '{') ? GUAVA_TRUE : GUAVA_FALSE;
+}
+
+static guava_router_template_t *guava_router_template_node_new(guava_router_segment_type_t type,
+                                                               const char *label,
+                                                               size_t len) {
+  guava_router_template_t *node = (guava_router_template_t *)guava_calloc(1, sizeof(guava_router_template_t));
+  if (!node) {
+    return NULL;
+  }
+
+  node->type = type;
+  node->label = guava_string_new_size(label, len);
+  return node;
+}
+
+guava_router_template_t *guava_router_template_new(void) {
+  return guava_router_template_node_new(GUAVA_ROUTER_SEGMENT_STATIC, "", 0);
+}
+
+void guava_router_template_free(guava_router_template_t *tree) {
+  if (!tree) {
+    return;
+  }
+
+  for (size_t i = 0; i < tree->nchildren; ++i) {
+    guava_router_template_free(tree->children[i]);
+  }
+
+  guava_free(tree->children);
+  guava_string_free(tree->label);
+  Py_XDECREF(tree->handler);
+  guava_free(tree);
+}
+
+static guava_router_template_t *guava_router_template_child(guava_router_template_t *node,
+                                                            guava_router_segment_type_t type,
+                                                            const char *label,
+                                                            size_t len) {
+  for (size_t i = 0; i < node->nchildren; ++i) {
+    guava_router_template_t *child = node->children[i];
+    if (child->type != type) {
+      continue;
+    }
+
+    /* All the parameters of one type share a node, only their position matters */
+    if (type != GUAVA_ROUTER_SEGMENT_STATIC ||
+        (guava_string_len(child->label) == len && memcmp(child->label, label, len) == 0)) {
+      return child;
+    }
+  }
+
+  guava_router_template_t *child = guava_router_template_node_new(type, label, len);
+  if (!child) {
+    return NULL;
+  }
+
+  guava_router_template_t **children = (guava_router_template_t **)guava_realloc(node->children,
+                                                                                 (node->nchildren + 1) * sizeof(*children));
+  if (!children) {
+    guava_router_template_free(child);
+    return NULL;
+  }
+
+  children[node->nchildren++] = child;
+  node->children = children;
+  return child;
+}
+
+static guava_bool_t guava_router_template_segment_type(const char *seg,
+                                                       size_t len,
+                                                       guava_router_segment_type_t *type) {
+  if (len < 2 || seg[0] != '{' || seg[len - 1] != '}') {
+    *type = GUAVA_ROUTER_SEGMENT_STATIC;
+    return GUAVA_TRUE;
+  }
+
+  const char *colon = memchr(seg, ':', len);
+  if (!colon) {
+    *type = GUAVA_ROUTER_SEGMENT_STR;
+    return GUAVA_TRUE;
+  }
+
+  size_t conv_len = seg + len - 1 - (colon + 1);
+  if (conv_len == 3 && memcmp(colon + 1, "int", 3) == 0) {
+    *type = GUAVA_ROUTER_SEGMENT_INT;
+  } else if (conv_len == 3 && memcmp(colon + 1, "str", 3) == 0) {
+    *type = GUAVA_ROUTER_SEGMENT_STR;
+  } else {
+    return GUAVA_FALSE;
+  }
+
+  return GUAVA_TRUE;
+}
+
+guava_bool_t guava_router_template_insert(guava_router_template_t *tree, const char *path, PyObject *handler) {
+  guava_router_template_t *node = tree;
+  const char *p = path;
+  const char *end = path + strlen(path);
+
+  while (p < end) {
+    if (*p == '/') {
+      ++p;
+      continue;
+    }
+
+    const char *q = memchr(p, '/', end - p);
+    if (!q) {
+      q = end;
+    }
+
+    guava_router_segment_type_t type;
+    if (!guava_router_template_segment_type(p, q - p, &type)) {
+      fprintf(stderr, "unknown converter in the route %s\n", path);
+      return GUAVA_FALSE;
+    }
+
+    node = guava_router_template_child(node, type, p, q - p);
+    if (!node) {
+      return GUAVA_FALSE;
+    }
+
+    p = q;
+  }
+
+  Py_XDECREF(node->handler);
+  Py_INCREF(handler);
+  node->handler = handler;
+
+  return GUAVA_TRUE;
+}
+
+static PyObject *guava_router_template_capture(guava_router_segment_type_t type, const char *seg, size_t len) {
+  if (type == GUAVA_ROUTER_SEGMENT_STR) {
+    return PyString_FromStringAndSize(seg, len);
+  }
+
+  if (len > GUAVA_ROUTER_TEMPLATE_MAX_INT_LEN) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < len; ++i) {
+    if (!isdigit((unsigned char)seg[i])) {
+      return NULL;
+    }
+  }
+
+  char s[GUAVA_ROUTER_TEMPLATE_MAX_INT_LEN + 1];
+  memcpy(s, seg, len);
+  s[len] = '\0';
+
+  return PyInt_FromString(s, NULL, 10);
+}
+
+static PyObject *guava_router_template_match_node(guava_router_template_t *node,
+                                                  const char *p,
+                                                  const char *end,
+                                                  PyObject **captures) {
+  while (p < end && *p == '/') {
+    ++p;
+  }
+
+  if (p == end) {
+    return node->handler;
+  }
+
+  const char *q = memchr(p, '/', end - p);
+  if (!q) {
+    q = end;
+  }
+  size_t len = q - p;
+
+  /* Static segments win over parameters, and integers over strings */
+  for (int type = GUAVA_ROUTER_SEGMENT_STATIC; type <= GUAVA_ROUTER_SEGMENT_STR; ++type) {
+    for (size_t i = 0; i < node->nchildren; ++i) {
+      guava_router_template_t *child = node->children[i];
+      if (child->type != type) {
+        continue;
+      }
+
+      if (type == GUAVA_ROUTER_SEGMENT_STATIC) {
+        if (guava_string_len(child->label) != len || memcmp(child->label, p, len) != 0) {
+          continue;
+        }
+
+        PyObject *handler = guava_router_template_match_node(child, q, end, captures);
+        if (handler) {
+          return handler;
+        }
+        continue;
+      }
+
+      PyObject *value = guava_router_template_capture(child->type, p, len);
+      if (!value) {
+        PyErr_Clear();
+        continue;
+      }
+
+      if (!*captures) {
+        *captures = PyList_New(0);
+      }
+      PyList_Append(*captures, value);
+      Py_DECREF(value);
+
+      PyObject *handler = guava_router_template_match_node(child, q, end, captures);
+      if (handler) {
+        return handler;
+      }
+
+      Py_ssize_t n = PyList_Size(*captures);
+      PyList_SetSlice(*captures, n - 1, n, NULL);
+    }
+  }
+
+  return NULL;
+}
+
+PyObject *guava_router_template_match(guava_router_template_t *tree, const char *path, size_t len, PyObject **args) {
+  PyObject *captures = NULL;
+
+  *args = NULL;
+
+  PyObject *handler = guava_router_template_match_node(tree, path, path + len, &captures);
+  if (handler && captures && PyList_Size(captures) > 0) {
+    *args = PyList_AsTuple(captures);
+  }
+
+  Py_XDECREF(captures);
+  return handler;
+}
+
+guava_router_template_t *guava_router_template_compile(PyObject *routes) {
+  guava_router_template_t *tree = guava_router_template_new();
+  if (!tree) {
+    return NULL;
+  }
+
+  PyObject *key = NULL, *value = NULL;
+  Py_ssize_t pos = 0;
+
+  while (PyDict_Next(routes, &pos, &key, &value)) {
+    if (!PyString_Check(key)) {
+      continue;
+    }
+
+    const char *path = PyString_AsString(key);
+    if (guava_router_template_is_template(path)) {
+      guava_router_template_insert(tree, path, value);
+    }
+  }
+
+  return tree;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_router/guava_router_tree.h"
+#include "guava_string.h"
+#include "guava_module.h"
+#include "guava_memory.h"
+
+static guava_router_node_t *guava_router_node_new(const char *label, size_t len) {
+  guava_router_node_t *node = (guava_router_node_t *)guava_calloc(1, sizeof(guava_router_node_t));
+  if (!node) {
+    return NULL;
+  }
+
+  node->label = guava_string_new_size(label, len);
+  return node;
+}
+
+guava_router_node_t *guava_router_tree_new(void) {
+  return guava_router_node_new("", 0);
+}
+
+void guava_router_tree_free(guava_router_node_t *tree) {
+  if (!tree) {
+    return;
+  }
+
+  for (size_t i = 0; i < tree->nchildren; ++i) {
+    guava_router_tree_free(tree->children[i]);
+  }
+
+  guava_free(tree->children);
+  guava_string_free(tree->label);
+  Py_XDECREF(tree->router);
+  guava_free(tree);
+}
+
+static guava_router_node_t *guava_router_node_child(guava_router_node_t *node, char c) {
+  for (size_t i = 0; i < node->nchildren; ++i) {
+    if (node->children[i]->label[0] == c) {
+      return node->children[i];
+    }
+  }
+
+  return NULL;
+}
+
+static guava_bool_t guava_router_node_add_child(guava_router_node_t *node, guava_router_node_t *child) {
+  guava_router_node_t **children = (guava_router_node_t **)guava_realloc(node->children,
+                                                                         (node->nchildren + 1) * sizeof(*children));
+  if (!children) {
+    return GUAVA_FALSE;
+  }
+
+  children[node->nchildren++] = child;
+  node->children = children;
+  return GUAVA_TRUE;
+}
+
+void guava_router_tree_insert(guava_router_node_t *tree, const char *mount_point, size_t len, PyObject *router) {
+  guava_router_node_t *node = tree;
+  size_t pos = 0;
+
+  while (pos < len) {
+    guava_router_node_t *child = guava_router_node_child(node, mount_point[pos]);
+
+    if (!child) {
+      child = guava_router_node_new(mount_point + pos, len - pos);
+      if (!child || !guava_router_node_add_child(node, child)) {
+        return;
+      }
+      node = child;
+      break;
+    }
+
+    size_t label_len = guava_string_len(child->label);
+    size_t common = 0;
+    while (common < label_len && pos + common < len && child->label[common] == mount_point[pos + common]) {
+      ++common;
+    }
+
+    if (common < label_len) {
+      /* Split the edge, the common part becomes a new node in between */
+      guava_router_node_t *middle = guava_router_node_new(child->label, common);
+      if (!middle) {
+        return;
+      }
+
+      guava_string_t rest = guava_string_new_size(child->label + common, label_len - common);
+      guava_string_free(child->label);
+      child->label = rest;
+
+      guava_router_node_add_child(middle, child);
+      for (size_t i = 0; i < node->nchildren; ++i) {
+        if (node->children[i] == child) {
+          node->children[i] = middle;
+        }
+      }
+      child = middle;
+    }
+
+    node = child;
+    pos += common;
+  }
+
+  /* The first router mounted on a path wins, as it did with the list scan */
+  if (!node->router) {
+    Py_INCREF(router);
+    node->router = router;
+  }
+}
+
+PyObject *guava_router_tree_match(guava_router_node_t *tree, const char *path, size_t len) {
+  guava_router_node_t *node = tree;
+  PyObject *router = tree->router;
+  size_t pos = 0;
+
+  while (pos < len) {
+    node = guava_router_node_child(node, path[pos]);
+    if (!node) {
+      break;
+    }
+
+    size_t label_len = guava_string_len(node->label);
+    if (label_len > len - pos || memcmp(node->label, path + pos, label_len) != 0) {
+      break;
+    }
+
+    pos += label_len;
+    if (node->router) {
+      router = node->router;
+    }
+  }
+
+  return router;
+}
+
+guava_router_node_t *guava_router_tree_compile(PyObject *routers) {
+  guava_router_node_t *tree = guava_router_tree_new();
+  if (!tree) {
+    return NULL;
+  }
+
+  Py_ssize_t size = PyList_Size(routers);
+  for (Py_ssize_t i = 0; i < size; ++i) {
+    Router *r = (Router *)PyList_GetItem(routers, i);
+    /* Custom routers have no mount point, they are asked one by one */
+    if (r->router->type == GUAVA_ROUTER_CUSTOM || !r->router->mount_point) {
+      continue;
+    }
+
+    guava_router_tree_insert(tree, r->router->mount_point, guava_string_len(r->router->mount_point), (PyObject *)r);
+  }
+
+  return tree;
+}
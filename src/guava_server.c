@@ -6,10 +6,24 @@
 
 #include "guava_server.h"
 #include "guava_conn.h"
+#include "guava_request.h"
 #include "guava_router/guava_router.h"
+#include "guava_router/guava_router_tree.h"
 #include "guava_module.h"
 #include "guava_module_router.h"
 #include "guava_memory.h"
+#include "guava_slab.h"
+#include "guava_timer_wheel.h"
+#include "guava_file_cache.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <time.h>
+
+static volatile sig_atomic_t guava_server_stopping = 0;
 
 guava_server_t *guava_server_new() {
   guava_server_t *server = (guava_server_t *)guava_calloc(1, sizeof(guava_server_t));
@@ -19,23 +33,32 @@ guava_server_t *guava_server_new() {
 
   server->routers = NULL;
   server->debug = GUAVA_FALSE;
+  server->workers = GUAVA_SERVER_DEFAULT_WORKERS;
+  server->conn_high_water = GUAVA_SERVER_DEFAULT_CONN_HIGH_WATER;
+  server->response_high_water = GUAVA_SERVER_DEFAULT_RESPONSE_HIGH_WATER;
+  server->header_timeout = GUAVA_SERVER_DEFAULT_HEADER_TIMEOUT;
+  server->body_timeout = GUAVA_SERVER_DEFAULT_BODY_TIMEOUT;
+  server->keepalive_timeout = GUAVA_SERVER_DEFAULT_KEEPALIVE_TIMEOUT;
+  server->write_timeout = GUAVA_SERVER_DEFAULT_WRITE_TIMEOUT;
+  server->upload_spill_size = GUAVA_SERVER_DEFAULT_UPLOAD_SPILL_SIZE;
+  server->arena_high_water = 0;
+  server->static_memory_budget = GUAVA_FILE_CACHE_MEMORY_BUDGET;
 
   return server;
 }
 
 void guava_server_free(guava_server_t *server) {
+  guava_router_tree_free(server->router_tree);
   Py_XDECREF(server->routers);
   guava_free(server);
 }
 
 void guava_server_on_conn(uv_stream_t *stream, int status) {
-  guava_conn_t *conn = guava_conn_new();
-
-  http_parser_init(&conn->parser, HTTP_REQUEST);
-
   guava_server_t *server = (guava_server_t *)stream->data;
 
-  conn->server = server;
+  guava_conn_t *conn = guava_conn_new(server);
+
+  http_parser_init(&conn->parser, HTTP_REQUEST);
 
   uv_tcp_init(&server->loop, &conn->stream);
 
@@ -44,10 +67,26 @@ void guava_server_on_conn(uv_stream_t *stream, int status) {
 
   uv_accept(stream, (uv_stream_t *)&conn->stream);
   uv_read_start((uv_stream_t *)&conn->stream, guava_server_on_alloc, guava_server_on_read);
+
+  guava_conn_set_timeout(conn, server->header_timeout);
 }
 
 void guava_server_on_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf) {
-  *buf = uv_buf_init((char *)guava_malloc(suggested_size), (unsigned int)suggested_size);
+  guava_conn_t *conn = (guava_conn_t *)handle->data;
+  guava_server_t *server = conn->server;
+
+  /* Keep-alive connections waiting for the next request only get a small buffer */
+  guava_slab_t *slab = conn->request ? &server->read_buffers : &server->idle_read_buffers;
+
+  *buf = uv_buf_init((char *)guava_slab_alloc(slab), (unsigned int)slab->size);
+}
+
+static void guava_server_release_read_buffer(guava_server_t *server, const uv_buf_t *buf) {
+  if (buf->len == server->read_buffers.size) {
+    guava_slab_free(&server->read_buffers, buf->base);
+  } else {
+    guava_slab_free(&server->idle_read_buffers, buf->base);
+  }
 }
 
 void guava_server_on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
@@ -55,17 +94,34 @@ void guava_server_on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *bu
   if (nread < 0 || nread == UV_EOF) {
     uv_close((uv_handle_t *)&conn->stream, guava_server_on_close);
   } else if (nread > 0) {
+    /* Pipelined requests in this read are answered with one write */
+    conn->in_read = 1;
     if(http_parser_execute(&conn->parser, &conn->parser_settings, buf->base, nread) != (size_t)nread) {
       fprintf(stderr, "400\n");
     }
+    conn->in_read = 0;
+    if (conn->request) {
+      /* The request continues in the next read, this buffer goes back to the pool */
+      guava_request_retain_headers(((Request *)conn->request)->req);
+    }
+    guava_conn_flush(conn);
   }
   if (buf->base) {
-    guava_free(buf->base);
+    guava_server_release_read_buffer(conn->server, buf);
   }
 }
 
 void guava_server_on_close(uv_handle_t *handle) {
   guava_conn_t *conn = (guava_conn_t *)handle->data;
+
+  guava_conn_close_poll(conn);
+
+  if (conn->sending || conn->parked || conn->poll_open) {
+    /* The sendfile, filesystem or poll close callback frees the conn once it is done */
+    conn->closed = 1;
+    return;
+  }
+
   guava_conn_free(conn);
 }
 
@@ -74,36 +130,120 @@ void signal_shutdown_cb(uv_signal_t *handle, int signum) {
 
   guava_server_t *server = (guava_server_t *)handle->data;
 
-  uv_loop_close(&server->loop);
-
+  /* guava_server_run closes what is left once the loop returns */
   uv_signal_stop(&server->signal);
+  uv_stop(&server->loop);
+}
 
-  exit(0);
+static void guava_server_close_handle(uv_handle_t *handle, void *arg) {
+  guava_server_t *server = (guava_server_t *)arg;
+
+  if (uv_is_closing(handle)) {
+    return;
+  }
+
+  if (handle == (uv_handle_t *)&server->server || handle == (uv_handle_t *)&server->signal) {
+    uv_close(handle, NULL);
+  } else if (handle->type == UV_TCP) {
+    /* A connection, it is freed by its close callback. Its other handles go with it */
+    uv_close(handle, guava_server_on_close);
+  }
 }
 
-void guava_server_start(guava_server_t *server, const char *ip, uint16_t port, int backlog) {
-  if (!server->routers) {
-    fprintf(stderr, "No routers set, will use the default router: StaticRouter\n");
+static void guava_server_update_date(guava_server_t *server) {
+  time_t now = time(NULL);
+  struct tm tm;
 
-    StaticRouter *static_router = (StaticRouter *)PyObject_New(StaticRouter, &StaticRouterType);
-    static_router->router.router = (guava_router_t *)guava_router_static_new();
-    guava_router_set_mount_point((guava_router_t *)static_router->router.router, "/");
-    guava_router_static_set_directory((guava_router_static_t *)static_router->router.router, ".");
-    guava_router_static_set_allow_index((guava_router_static_t *)static_router->router.router, GUAVA_TRUE);
-    guava_server_add_router(server, (Router *)static_router);
+  gmtime_r(&now, &tm);
+  server->date_len = strftime(server->date, sizeof(server->date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+}
+
+static void guava_server_on_date_timer(uv_timer_t *handle) {
+  guava_server_update_date((guava_server_t *)handle->data);
+}
+
+/* A worker exits with it when it can't listen, the supervisor doesn't respawn it then */
+#define GUAVA_SERVER_WORKER_STARTUP_FAILURE 2
+
+static int guava_server_reuseport_socket(const char *ip, uint16_t port, guava_bool_t reuseport) {
+  struct sockaddr_in address;
+  int on = 1;
+
+  if (uv_ip4_addr(ip, port, &address) != 0) {
+    errno = EINVAL;
+    return -1;
   }
 
-  fprintf(stdout, "Listening on %s:%d...\n", ip, port);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+#ifdef SO_REUSEPORT
+  if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+#endif
 
+  if (bind(fd, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  return fd;
+}
+
+static void guava_server_run(guava_server_t *server, const char *ip, uint16_t port, int backlog, guava_bool_t reuseport) {
   uv_loop_init(&server->loop);
 
+  guava_slab_init(&server->read_buffers, GUAVA_SERVER_READ_BUFFER_SIZE, GUAVA_SERVER_READ_BUFFER_POOL_SIZE);
+  guava_slab_init(&server->idle_read_buffers, GUAVA_SERVER_IDLE_READ_BUFFER_SIZE, GUAVA_SERVER_IDLE_READ_BUFFER_POOL_SIZE);
+  guava_slab_init(&server->header_buffers, GUAVA_SERVER_HEADER_BUFFER_SIZE, GUAVA_SERVER_HEADER_BUFFER_POOL_SIZE);
+  guava_slab_init(&server->conns, sizeof(guava_conn_t), server->conn_high_water);
+  guava_slab_init(&server->responses, sizeof(guava_response_t), server->response_high_water);
+
+  guava_timer_wheel_init(&server->timers, &server->loop);
+  guava_file_cache_init(&server->files, &server->loop, GUAVA_FILE_CACHE_SIZE, server->static_memory_budget);
+
+  /* Responses copy the Date header from here, it only changes once a second */
+  guava_server_update_date(server);
+  uv_timer_init(&server->loop, &server->date_timer);
+  server->date_timer.data = server;
+  uv_timer_start(&server->date_timer, guava_server_on_date_timer, GUAVA_SERVER_DATE_INTERVAL, GUAVA_SERVER_DATE_INTERVAL);
+  uv_unref((uv_handle_t *)&server->date_timer);
+
   uv_tcp_init(&server->loop, &server->server);
 
-  struct sockaddr_in address;
+  if (reuseport) {
+    /*
+     * Every worker owns its own listen socket bound with SO_REUSEPORT,
+     * so the kernel balances the incoming connections between workers
+     */
+    int fd = guava_server_reuseport_socket(ip, port, GUAVA_TRUE);
+    if (fd < 0) {
+      fprintf(stderr, "[%d] failed to bind %s:%d: %s\n", getpid(), ip, port, strerror(errno));
+      exit(GUAVA_SERVER_WORKER_STARTUP_FAILURE);
+    }
+    int err = uv_tcp_open(&server->server, fd);
+    if (err < 0) {
+      fprintf(stderr, "[%d] failed to open the listen socket: %s\n", getpid(), uv_strerror(err));
+      close(fd);
+      exit(GUAVA_SERVER_WORKER_STARTUP_FAILURE);
+    }
+  } else {
+    struct sockaddr_in address;
 
-  uv_ip4_addr(ip, port, &address);
+    uv_ip4_addr(ip, port, &address);
 
-  uv_tcp_bind(&server->server, (const struct sockaddr *)&address, 0);
+    uv_tcp_bind(&server->server, (const struct sockaddr *)&address, 0);
+  }
 
   server->server.data = server;
 
@@ -116,6 +256,204 @@ void guava_server_start(guava_server_t *server, const char *ip, uint16_t port, i
   /* Py_BEGIN_ALLOW_THREADS */
   uv_run(&server->loop, UV_RUN_DEFAULT);
   /* Py_END_ALLOW_THREADS */
+
+  /* Stopped by a signal, the loop runs until the connections and then the cached files are closed */
+  uv_walk(&server->loop, guava_server_close_handle, server);
+  guava_timer_wheel_close(&server->timers);
+  uv_timer_stop(&server->date_timer);
+  uv_close((uv_handle_t *)&server->date_timer, NULL);
+  uv_run(&server->loop, UV_RUN_DEFAULT);
+
+  guava_file_cache_close(&server->files);
+  uv_run(&server->loop, UV_RUN_DEFAULT);
+  uv_loop_close(&server->loop);
+
+  guava_slab_deinit(&server->read_buffers);
+  guava_slab_deinit(&server->idle_read_buffers);
+  guava_slab_deinit(&server->header_buffers);
+  guava_slab_deinit(&server->conns);
+  guava_slab_deinit(&server->responses);
+}
+
+static void guava_server_master_signal_cb(int signum) {
+  guava_server_stopping = 1;
+}
+
+static pid_t guava_server_spawn_worker(guava_server_t *server, const char *ip, uint16_t port, int backlog) {
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    fprintf(stderr, "failed to fork the worker: %s\n", strerror(errno));
+    return pid;
+  }
+
+  if (pid == 0) {
+    PyOS_AfterFork();
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    guava_server_run(server, ip, port, backlog, GUAVA_TRUE);
+    exit(0);
+  }
+
+  return pid;
+}
+
+static void guava_server_supervise(guava_server_t *server, const char *ip, uint16_t port, int backlog) {
+  int workers = server->workers;
+  pid_t *pids = (pid_t *)guava_calloc(workers, sizeof(pid_t));
+  time_t *started = (time_t *)guava_calloc(workers, sizeof(time_t));
+  guava_bool_t *failed = (guava_bool_t *)guava_calloc(workers, sizeof(guava_bool_t));
+  int nfailed = 0;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = guava_server_master_signal_cb;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  while (!guava_server_stopping) {
+    guava_bool_t missing = GUAVA_FALSE;
+
+    /* Fills the empty slots, a failed fork is retried on the next round */
+    for (int i = 0; i < workers; ++i) {
+      if (pids[i] > 0 || failed[i]) {
+        continue;
+      }
+
+      /* Avoid a fork storm if the worker keeps dying right after starting */
+      if (started[i] && time(NULL) - started[i] < 1) {
+        missing = GUAVA_TRUE;
+        continue;
+      }
+
+      started[i] = time(NULL);
+      pids[i] = guava_server_spawn_worker(server, ip, port, backlog);
+      if (pids[i] <= 0) {
+        missing = GUAVA_TRUE;
+      }
+    }
+
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, missing ? WNOHANG : 0);
+
+    if (pid == 0 || (pid < 0 && errno == ECHILD && missing)) {
+      sleep(1);
+      continue;
+    }
+
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+
+    if (guava_server_stopping) {
+      break;
+    }
+
+    for (int i = 0; i < workers; ++i) {
+      if (pids[i] != pid) {
+        continue;
+      }
+
+      pids[i] = 0;
+
+      /* It would only fail the same way again */
+      if (WIFEXITED(status) && WEXITSTATUS(status) == GUAVA_SERVER_WORKER_STARTUP_FAILURE) {
+        fprintf(stderr, "Worker %d failed to start, not respawning it\n", pid);
+        failed[i] = GUAVA_TRUE;
+        ++nfailed;
+        break;
+      }
+
+      fprintf(stderr, "Worker %d exited with status %d, respawning\n", pid, status);
+      break;
+    }
+
+    if (nfailed == workers) {
+      fprintf(stderr, "No worker could start, giving up\n");
+      guava_free(pids);
+      guava_free(started);
+      guava_free(failed);
+      exit(1);
+    }
+  }
+
+  fprintf(stderr, "Caught signal, ready to shutdown the workers\n");
+
+  for (int i = 0; i < workers; ++i) {
+    if (pids[i] > 0) {
+      kill(pids[i], SIGTERM);
+    }
+  }
+
+  while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+  }
+
+  guava_free(pids);
+  guava_free(started);
+  guava_free(failed);
+
+  exit(0);
+}
+
+/*
+ * Returns 0 once the server stopped, or the errno if the address can't be
+ * listened on. That is checked up front so no worker is forked in vain.
+ */
+int guava_server_start(guava_server_t *server, const char *ip, uint16_t port, int backlog) {
+  if (!server->routers) {
+    fprintf(stderr, "No routers set, will use the default router: StaticRouter\n");
+
+    StaticRouter *static_router = (StaticRouter *)PyObject_New(StaticRouter, &StaticRouterType);
+    static_router->router.router = (guava_router_t *)guava_router_static_new();
+    guava_router_set_mount_point((guava_router_t *)static_router->router.router, "/");
+    guava_router_static_set_directory((guava_router_static_t *)static_router->router.router, ".");
+    guava_router_static_set_allow_index((guava_router_static_t *)static_router->router.router, GUAVA_TRUE);
+    guava_server_add_router(server, (Router *)static_router);
+    Py_DECREF(static_router);
+  }
+
+  /* Compile the mount points once, the workers inherit the tree */
+  guava_router_tree_free(server->router_tree);
+  server->router_tree = guava_router_tree_compile(server->routers);
+  server->router_tree_size = PyList_Size(server->routers);
+
+#ifndef SO_REUSEPORT
+  if (server->workers > 1) {
+    /* Only one socket could be bound to the address */
+    fprintf(stderr, "SO_REUSEPORT is not supported here, running with 1 worker instead of %d\n", server->workers);
+    server->workers = 1;
+  }
+#endif
+
+  int fd = guava_server_reuseport_socket(ip, port, server->workers > 1);
+  if (fd < 0 || listen(fd, backlog) < 0) {
+    int err = errno;
+    fprintf(stderr, "failed to listen on %s:%d: %s\n", ip, port, strerror(err));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return err;
+  }
+  close(fd);
+
+  if (server->workers > 1) {
+    fprintf(stdout, "Listening on %s:%d with %d workers...\n", ip, port, server->workers);
+    fflush(stdout);
+
+    guava_server_supervise(server, ip, port, backlog);
+    return 0;
+  }
+
+  fprintf(stdout, "Listening on %s:%d...\n", ip, port);
+
+  guava_server_run(server, ip, port, backlog, GUAVA_FALSE);
+  return 0;
 }
 
 void guava_server_add_router(guava_server_t *server, Router *router) {
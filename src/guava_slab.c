@@ -0,0 +1,57 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_slab.h"
+#include "guava_memory.h"
+
+void guava_slab_init(guava_slab_t *slab, size_t size, size_t high_water) {
+  /* The free list is linked through the first word of every free object */
+  slab->size = size < sizeof(void *) ? sizeof(void *) : size;
+  slab->high_water = high_water;
+  slab->nfree = 0;
+  slab->free_list = NULL;
+  slab->hits = 0;
+  slab->misses = 0;
+}
+
+void guava_slab_deinit(guava_slab_t *slab) {
+  while (slab->free_list) {
+    void *p = slab->free_list;
+    slab->free_list = *(void **)p;
+    guava_free(p);
+  }
+
+  slab->nfree = 0;
+}
+
+void *guava_slab_alloc(guava_slab_t *slab) {
+  void *p = slab->free_list;
+
+  if (p) {
+    slab->free_list = *(void **)p;
+    --slab->nfree;
+    ++slab->hits;
+    return p;
+  }
+
+  ++slab->misses;
+  return guava_malloc(slab->size);
+}
+
+void guava_slab_free(guava_slab_t *slab, void *p) {
+  if (!p) {
+    return;
+  }
+
+  if (slab->nfree >= slab->high_water) {
+    guava_free(p);
+    return;
+  }
+
+  *(void **)p = slab->free_list;
+  slab->free_list = p;
+  ++slab->nfree;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_strbuf.h"
+#include "guava_string.h"
+#include "guava_memory.h"
+#include <stdarg.h>
+
+#define GUAVA_STRBUF_MIN_SIZE 64
+
+static guava_string_header_t *guava_strbuf_header(guava_strbuf_t *buf) {
+  return (guava_string_header_t *)(buf->data - sizeof(guava_string_header_t));
+}
+
+void guava_strbuf_init(guava_strbuf_t *buf) {
+  buf->data = NULL;
+  buf->len = 0;
+  buf->size = 0;
+  buf->flags = 0;
+}
+
+void guava_strbuf_init_borrowed(guava_strbuf_t *buf, char *mem, size_t size) {
+  buf->data = mem;
+  buf->len = 0;
+  buf->size = size - 1;
+  buf->flags = GUAVA_STRBUF_BORROWED;
+  mem[0] = '\0';
+}
+
+void guava_strbuf_deinit(guava_strbuf_t *buf) {
+  if (buf->data && !(buf->flags & GUAVA_STRBUF_BORROWED)) {
+    guava_free(guava_strbuf_header(buf));
+  }
+
+  guava_strbuf_init(buf);
+}
+
+void guava_strbuf_clear(guava_strbuf_t *buf) {
+  buf->len = 0;
+  if (buf->data) {
+    buf->data[0] = '\0';
+  }
+}
+
+guava_bool_t guava_strbuf_reserve(guava_strbuf_t *buf, size_t len) {
+  if (buf->data && buf->len + len <= buf->size) {
+    return GUAVA_TRUE;
+  }
+
+  size_t size = buf->size ? buf->size * 2 : GUAVA_STRBUF_MIN_SIZE;
+  while (size < buf->len + len) {
+    size *= 2;
+  }
+
+  guava_string_header_t *h = NULL;
+  if (!buf->data || buf->flags & GUAVA_STRBUF_BORROWED) {
+    h = (guava_string_header_t *)guava_malloc(sizeof(guava_string_header_t) + size + 1);
+    if (!h) {
+      return GUAVA_FALSE;
+    }
+
+    if (buf->data) {
+      memcpy(h->data, buf->data, buf->len);
+    }
+    h->data[buf->len] = '\0';
+    buf->flags &= ~GUAVA_STRBUF_BORROWED;
+  } else {
+    h = (guava_string_header_t *)guava_realloc(guava_strbuf_header(buf), sizeof(guava_string_header_t) + size + 1);
+    if (!h) {
+      return GUAVA_FALSE;
+    }
+  }
+
+  h->flags = 0;
+  buf->data = h->data;
+  buf->size = size;
+  return GUAVA_TRUE;
+}
+
+void guava_strbuf_append(guava_strbuf_t *buf, const char *s, size_t len) {
+  if (!guava_strbuf_reserve(buf, len)) {
+    return;
+  }
+
+  memcpy(buf->data + buf->len, s, len);
+  buf->len += len;
+  buf->data[buf->len] = '\0';
+}
+
+void guava_strbuf_append_raw(guava_strbuf_t *buf, const char *s) {
+  guava_strbuf_append(buf, s, strlen(s));
+}
+
+void guava_strbuf_append_char(guava_strbuf_t *buf, char c) {
+  if (!guava_strbuf_reserve(buf, 1)) {
+    return;
+  }
+
+  buf->data[buf->len++] = c;
+  buf->data[buf->len] = '\0';
+}
+
+void guava_strbuf_append_uint(guava_strbuf_t *buf, uint64_t v) {
+  char digits[20];
+  size_t n = sizeof(digits);
+
+  do {
+    digits[--n] = '0' + (char)(v % 10);
+    v /= 10;
+  } while (v);
+
+  guava_strbuf_append(buf, digits + n, sizeof(digits) - n);
+}
+
+void guava_strbuf_append_int(guava_strbuf_t *buf, int64_t v) {
+  if (v < 0) {
+    guava_strbuf_append_char(buf, '-');
+    guava_strbuf_append_uint(buf, (uint64_t)-(v + 1) + 1);
+  } else {
+    guava_strbuf_append_uint(buf, (uint64_t)v);
+  }
+}
+
+void guava_strbuf_append_fmt(guava_strbuf_t *buf, const char *fmt, ...) {
+  va_list ap;
+
+  if (!guava_strbuf_reserve(buf, strlen(fmt) + 1)) {
+    return;
+  }
+
+  /* Formatted right into the spare room, again after growing if it didn't fit */
+  va_start(ap, fmt);
+  int n = vsnprintf(buf->data + buf->len, buf->size - buf->len + 1, fmt, ap);
+  va_end(ap);
+
+  if (n < 0) {
+    buf->data[buf->len] = '\0';
+    return;
+  }
+
+  if ((size_t)n > buf->size - buf->len) {
+    if (!guava_strbuf_reserve(buf, (size_t)n)) {
+      buf->data[buf->len] = '\0';
+      return;
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->len, buf->size - buf->len + 1, fmt, ap);
+    va_end(ap);
+  }
+
+  buf->len += (size_t)n;
+}
+
+guava_string_t guava_strbuf_to_string(guava_strbuf_t *buf) {
+  if (!buf->data || buf->flags & GUAVA_STRBUF_BORROWED) {
+    guava_string_t s = guava_string_new_size(buf->data, buf->len);
+    guava_strbuf_deinit(buf);
+    return s;
+  }
+
+  /* The buffer is handed over as it is, the spare room goes along */
+  guava_strbuf_header(buf)->len = buf->len;
+  guava_string_t s = buf->data;
+  guava_strbuf_init(buf);
+  return s;
+}
+
+void guava_strbuf_from_string(guava_strbuf_t *buf, guava_string_t gs) {
+  guava_strbuf_init(buf);
+
+  if (guava_string_is_arena(gs)) {
+    guava_strbuf_append(buf, gs, guava_string_len(gs));
+    return;
+  }
+
+  buf->data = gs;
+  buf->len = guava_string_len(gs);
+  buf->size = buf->len;
+}
@@ -6,8 +6,19 @@
 
 #include "guava_string.h"
 #include "guava_memory.h"
+#include "guava_arena.h"
 #include <string.h>
 
+#define GUAVA_STRING_MIN_ROOM 32
+
+static size_t guava_string_room(size_t size) {
+  size_t room = GUAVA_STRING_MIN_ROOM;
+  while (room < size) {
+    room *= 2;
+  }
+  return room;
+}
+
 guava_string_t guava_string_new(const char *init) {
   return guava_string_new_size(init, init ? strlen(init) : 0);
 }
@@ -26,6 +37,7 @@ guava_string_t guava_string_new_size(const char *init, size_t len) {
   }
 
   h->len = len;
+  h->flags = 0;
 
   if (len && init) {
     memcpy(h->data, init, len);
@@ -38,9 +50,64 @@ guava_string_t guava_string_new_size(const char *init, size_t len) {
 
 void guava_string_free(const guava_string_t gs) {
   guava_string_header_t *h = (guava_string_header_t *)((char *)gs - sizeof(guava_string_header_t));
+  if (h->flags & GUAVA_STRING_ARENA) {
+    return;
+  }
   guava_free(h);
 }
 
+guava_bool_t guava_string_is_arena(const guava_string_t gs) {
+  guava_string_header_t *h = (guava_string_header_t *)((char *)gs - sizeof(guava_string_header_t));
+  return h->flags & GUAVA_STRING_ARENA ? GUAVA_TRUE : GUAVA_FALSE;
+}
+
+guava_string_t guava_string_arena_new_size(guava_arena_t *arena, const char *init, size_t len) {
+  if (!arena) {
+    return guava_string_new_size(init, len);
+  }
+
+  guava_string_header_t *h = guava_arena_alloc(arena, sizeof(guava_string_header_t) + len + 1);
+  if (!h) {
+    return NULL;
+  }
+
+  h->len = len;
+  h->flags = GUAVA_STRING_ARENA;
+
+  if (len && init) {
+    memcpy(h->data, init, len);
+  } else if (len) {
+    memset(h->data, 0, len);
+  }
+
+  h->data[len] = '\0';
+
+  return (char *)h->data;
+}
+
+guava_string_t guava_string_arena_append_raw_size(guava_arena_t *arena, const guava_string_t gs, const char *s, size_t len) {
+  if (!gs) {
+    return guava_string_arena_new_size(arena, s, len);
+  }
+
+  guava_string_header_t *h = (guava_string_header_t *)((char *)gs - sizeof(guava_string_header_t));
+  if (!arena || !(h->flags & GUAVA_STRING_ARENA)) {
+    return guava_string_append_raw_size(gs, s, len);
+  }
+
+  size_t size = sizeof(guava_string_header_t) + h->len + 1;
+  h = guava_arena_realloc(arena, h, size, size + len);
+  if (!h) {
+    return NULL;
+  }
+
+  memcpy(h->data + h->len, s, len);
+  h->len += len;
+  h->data[h->len] = '\0';
+
+  return h->data;
+}
+
 guava_string_t guava_string_append(const guava_string_t gs, const guava_string_t gs2) {
   guava_string_header_t *h = (guava_string_header_t *)((char *)gs2 - sizeof(guava_string_header_t));
   return guava_string_append_raw_size(gs, h->data, h->len);
@@ -57,7 +124,26 @@ guava_string_t guava_string_append_raw_size(const guava_string_t gs, const char
   }
 
   h = (guava_string_header_t *)((char *)gs - sizeof(guava_string_header_t));
-  h = guava_realloc(h, sizeof(guava_string_header_t) + h->len + len + 1);
+  if (h->flags & GUAVA_STRING_ARENA) {
+    /* Arena strings can't be realloc'ed, they continue on the heap */
+    guava_string_t copy = guava_string_new_size(NULL, h->len + len);
+    if (copy) {
+      memcpy(copy, h->data, h->len);
+      memcpy(copy + h->len, s, len);
+    }
+    return copy;
+  }
+
+  /* Grown ones have room up to the next power of two, appending byte by byte stays linear */
+  size_t size = sizeof(guava_string_header_t) + h->len + len + 1;
+  if (!(h->flags & GUAVA_STRING_GROWN) || size > guava_string_room(sizeof(guava_string_header_t) + h->len + 1)) {
+    guava_string_header_t *grown = guava_realloc(h, guava_string_room(size));
+    if (!grown) {
+      return NULL;
+    }
+    h = grown;
+    h->flags |= GUAVA_STRING_GROWN;
+  }
 
   memcpy(h->data + h->len, s, len);
   h->len += len;
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2014 The guava Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+#include "guava_timer_wheel.h"
+
+/*
+ * Hashed timing wheel: one uv_timer_t ticks once per GUAVA_TIMER_WHEEL_TICK
+ * and only the timers hashed into the current slot get visited, so adding,
+ * re-arming and removing a timer are all O(1) whatever the number of timers.
+ */
+
+static void guava_timer_wheel_on_tick(uv_timer_t *handle) {
+  guava_timer_wheel_t *wheel = (guava_timer_wheel_t *)handle->data;
+
+  wheel->current = (wheel->current + 1) % GUAVA_TIMER_WHEEL_SLOTS;
+
+  guava_timer_t *timer = wheel->slots[wheel->current];
+  while (timer) {
+    guava_timer_t *next = timer->next;
+
+    if (timer->rounds > 0) {
+      --timer->rounds;
+    } else {
+      guava_timer_wheel_remove(wheel, timer);
+      timer->cb(timer);
+    }
+
+    timer = next;
+  }
+
+  if (!wheel->count) {
+    uv_timer_stop(&wheel->timer);
+  }
+}
+
+void guava_timer_wheel_init(guava_timer_wheel_t *wheel, uv_loop_t *loop) {
+  memset(wheel, 0, sizeof(*wheel));
+
+  uv_timer_init(loop, &wheel->timer);
+  wheel->timer.data = wheel;
+
+  /* The wheel alone should never keep the loop alive */
+  uv_unref((uv_handle_t *)&wheel->timer);
+}
+
+void guava_timer_wheel_close(guava_timer_wheel_t *wheel) {
+  uv_timer_stop(&wheel->timer);
+  uv_close((uv_handle_t *)&wheel->timer, NULL);
+}
+
+void guava_timer_init(guava_timer_t *timer) {
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->slot = -1;
+  timer->rounds = 0;
+  timer->cb = NULL;
+}
+
+guava_bool_t guava_timer_is_active(guava_timer_t *timer) {
+  return timer->slot >= 0 ? GUAVA_TRUE : GUAVA_FALSE;
+}
+
+void guava_timer_wheel_add(guava_timer_wheel_t *wheel, guava_timer_t *timer, unsigned int timeout, guava_timer_cb cb) {
+  if (guava_timer_is_active(timer)) {
+    guava_timer_wheel_remove(wheel, timer);
+  }
+
+  /*
+   * The timeout is in seconds and fires within one tick after it elapsed,
+   * the extra tick covers the part of the current one which already passed
+   */
+  unsigned int ticks = timeout * 1000 / GUAVA_TIMER_WHEEL_TICK + 1;
+
+  int slot = (int)((wheel->current + ticks) % GUAVA_TIMER_WHEEL_SLOTS);
+
+  timer->slot = slot;
+  timer->rounds = (ticks - 1) / GUAVA_TIMER_WHEEL_SLOTS;
+  timer->cb = cb;
+  timer->prev = NULL;
+  timer->next = wheel->slots[slot];
+  if (timer->next) {
+    timer->next->prev = timer;
+  }
+  wheel->slots[slot] = timer;
+
+  if (wheel->count++ == 0) {
+    uv_timer_start(&wheel->timer, guava_timer_wheel_on_tick, GUAVA_TIMER_WHEEL_TICK, GUAVA_TIMER_WHEEL_TICK);
+  }
+}
+
+void guava_timer_wheel_remove(guava_timer_wheel_t *wheel, guava_timer_t *timer) {
+  if (!guava_timer_is_active(timer)) {
+    return;
+  }
+
+  if (timer->prev) {
+    timer->prev->next = timer->next;
+  } else {
+    wheel->slots[timer->slot] = timer->next;
+  }
+
+  if (timer->next) {
+    timer->next->prev = timer->prev;
+  }
+
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->slot = -1;
+
+  --wheel->count;
+}
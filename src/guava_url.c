@@ -6,6 +6,7 @@
 
 #include "guava_url.h"
 #include "guava_string.h"
+#include "guava_strbuf.h"
 #include <assert.h>
 
 /**
@@ -24,42 +25,42 @@ char n_to_hex(char c) {
 }
 
 guava_string_t guava_url_encode(const char *str) {
-	char *pstr = (char *)str, *buf = malloc(strlen(str) * 3 + 1), *pbuf = buf;
-	while (*pstr) {
+	guava_strbuf_t buf;
+	guava_strbuf_init(&buf);
+	guava_strbuf_reserve(&buf, strlen(str) * 3);
+
+	for (const char *pstr = str; *pstr; ++pstr) {
 		if (isalnum(*pstr) || *pstr == '-' || *pstr == '_' || *pstr == '.' || *pstr == '~') {
-			*pbuf++ = *pstr;
+			guava_strbuf_append_char(&buf, *pstr);
 		} else if (*pstr == ' ') {
-			*pbuf++ = '+';
+			guava_strbuf_append_char(&buf, '+');
 		} else {
-			*pbuf++ = '%', *pbuf++ = n_to_hex(*pstr >> 4), *pbuf++ = n_to_hex(*pstr & 15);
+			guava_strbuf_append_char(&buf, '%');
+			guava_strbuf_append_char(&buf, n_to_hex((*pstr >> 4) & 15));
+			guava_strbuf_append_char(&buf, n_to_hex(*pstr & 15));
 		}
-		pstr++;
 	}
-	*pbuf = '\0';
-	guava_string_t b = guava_string_new(buf);
-	free(buf);
 
-	return b;
+	return guava_strbuf_to_string(&buf);
 }
 
 guava_string_t guava_url_decode(const char *str) {
-	char *pstr = (char *)str, *buf = malloc(strlen(str) + 1), *pbuf = buf;
-	while (*pstr) {
+	guava_strbuf_t buf;
+	guava_strbuf_init(&buf);
+	guava_strbuf_reserve(&buf, strlen(str));
+
+	for (const char *pstr = str; *pstr; ++pstr) {
 		if (*pstr == '%') {
 			if (pstr[1] && pstr[2]) {
-				*pbuf++ = n_from_hex(pstr[1]) << 4 | n_from_hex(pstr[2]);
+				guava_strbuf_append_char(&buf, n_from_hex(pstr[1]) << 4 | n_from_hex(pstr[2]));
 				pstr += 2;
 			}
-		} else if (*pstr == '+') { 
-			*pbuf++ = ' ';
+		} else if (*pstr == '+') {
+			guava_strbuf_append_char(&buf, ' ');
 		} else {
-			*pbuf++ = *pstr;
+			guava_strbuf_append_char(&buf, *pstr);
 		}
-		pstr++;
 	}
-	*pbuf = '\0';
-	guava_string_t b = guava_string_new(buf);
-	free(buf);
 
-	return b;
-}
\ No newline at end of file
+	return guava_strbuf_to_string(&buf);
+}
@@ -0,0 +1,117 @@
+# Copyright 2014 The guava Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+import httplib
+import os
+import shutil
+import signal
+import socket
+import sys
+import tempfile
+import time
+
+import guava
+
+
+def free_port():
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    sock.bind(('127.0.0.1', 0))
+    port = sock.getsockname()[1]
+    sock.close()
+    return port
+
+
+def make_package(name, modules):
+    """Writes a package of controller modules to a temp dir on sys.path, returns the dir"""
+    directory = tempfile.mkdtemp()
+    package = os.path.join(directory, name)
+    os.mkdir(package)
+    open(os.path.join(package, '__init__.py'), 'w').close()
+    for module, source in modules.items():
+        with open(os.path.join(package, module + '.py'), 'w') as f:
+            f.write(source)
+
+    sys.path.insert(0, directory)
+    return directory
+
+
+def remove_package(directory):
+    sys.path.remove(directory)
+    shutil.rmtree(directory)
+
+
+class LiveServer(object):
+    """A guava server running in a child process, for the end to end tests"""
+
+    def __init__(self, routers=(), **kwargs):
+        self.routers = routers
+        self.kwargs = kwargs
+        self.port = free_port()
+        self.pid = None
+
+    def start(self):
+        pid = os.fork()
+        if pid == 0:
+            try:
+                server = guava.server.Server(ip='127.0.0.1', port=self.port, **self.kwargs)
+                if self.routers:
+                    server.add_router(*self.routers)
+                server.serve()
+            finally:
+                os._exit(0)
+
+        self.pid = pid
+
+        deadline = time.time() + 5
+        while True:
+            try:
+                socket.create_connection(('127.0.0.1', self.port), 1).close()
+                return
+            except socket.error:
+                if time.time() > deadline:
+                    self.stop()
+                    raise
+                time.sleep(0.05)
+
+    def stop(self):
+        if self.pid:
+            os.kill(self.pid, signal.SIGINT)
+            os.waitpid(self.pid, 0)
+            self.pid = None
+
+    def connect(self):
+        return socket.create_connection(('127.0.0.1', self.port), 5)
+
+    def request(self, path, headers=None, method='GET'):
+        conn = httplib.HTTPConnection('127.0.0.1', self.port, timeout=5)
+        try:
+            conn.request(method, path, headers=headers or {})
+            resp = conn.getresponse()
+            return resp, resp.read()
+        finally:
+            conn.close()
+
+    def send_chunks(self, chunks, delay=0.1):
+        """Sends a raw request in separate segments, returns the status, headers and body"""
+        sock = self.connect()
+        try:
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            for chunk in chunks:
+                sock.sendall(chunk)
+                time.sleep(delay)
+
+            data = ''
+            while True:
+                buf = sock.recv(65536)
+                if not buf:
+                    break
+                data += buf
+        finally:
+            sock.close()
+
+        head, _, body = data.partition('\r\n\r\n')
+        lines = head.split('\r\n')
+        status = int(lines[0].split(' ')[1])
+        headers = dict((k.lower(), v.strip()) for k, _, v in (line.partition(':') for line in lines[1:]))
+        return status, headers, body
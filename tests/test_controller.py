@@ -29,6 +29,7 @@ class TestController(unittest.TestCase):
         self.assertTrue(c.set_cookie != None)
 
         self.assertEqual(c.GET, {})
+        self.assertEqual(c.RESPONSE_HEADERS, {})
 
 
 if __name__ == '__main__':
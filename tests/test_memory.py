@@ -0,0 +1,125 @@
+# Copyright 2014 The guava Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+import httplib
+import os
+import signal
+import socket
+import subprocess
+import sys
+import time
+import unittest
+import guava
+
+from tests.live_server import LiveServer, free_port, make_package, remove_package
+
+
+HEADER_CONTROLLER = '''import guava
+
+
+class HeaderController(guava.controller.Controller):
+
+    def index(self):
+        self.set_header('X-Custom', 'first')
+        self.set_header('X-Custom', 'second')
+        self.write(str(guava.memory.stats()['live_objects']))
+'''
+
+# Runs in a fresh interpreter, the report at exit only covers this server
+SERVER_SCRIPT = '''import sys
+import guava
+
+server = guava.server.Server(ip='127.0.0.1', port=int(sys.argv[1]))
+server.add_router(guava.router.MVCRouter('/', package='memory_controllers'),
+                  guava.router.StaticRouter('/static', directory=sys.argv[2]))
+server.serve()
+'''
+
+
+class TestMemory(unittest.TestCase):
+
+    def test_stats(self):
+        stats = guava.memory.stats()
+        if not stats['enabled']:
+            return
+
+        self.assertTrue(stats['peak_bytes'] >= stats['live_bytes'])
+        self.assertEqual(stats['allocs'] - stats['frees'], stats['live_objects'])
+
+    def test_handler_reinit(self):
+        stats = guava.memory.stats()
+        if not stats['enabled']:
+            return
+
+        handler = guava.handler.Handler(module='module1', cls='Class', action='action')
+        live = guava.memory.stats()['live_objects']
+        handler.__init__(module='module2', cls='Class', action='action')
+        self.assertEqual(guava.memory.stats()['live_objects'], live)
+        self.assertEqual(handler.module, 'module2')
+
+    def test_custom_header_overwrite(self):
+        stats = guava.memory.stats()
+        if not stats['enabled']:
+            return
+
+        directory = make_package('memory_controllers', {'header': HEADER_CONTROLLER})
+        server = LiveServer(routers=(guava.router.MVCRouter('/', package='memory_controllers'),))
+        server.start()
+        try:
+            conn = httplib.HTTPConnection('127.0.0.1', server.port, timeout=5)
+            counts = []
+            for i in range(3):
+                conn.request('GET', '/header')
+                resp = conn.getresponse()
+                counts.append(int(resp.read()))
+                self.assertEqual(resp.getheader('X-Custom'), 'second')
+            conn.close()
+        finally:
+            server.stop()
+            remove_package(directory)
+
+        # Neither the overwritten value nor the custom name may outlive a request
+        self.assertEqual(counts[1], counts[2])
+
+    def test_no_leaks_after_shutdown(self):
+        stats = guava.memory.stats()
+        if not stats['enabled']:
+            return
+
+        directory = make_package('memory_controllers', {'header': HEADER_CONTROLLER})
+        with open(os.path.join(directory, 'file.txt'), 'w') as f:
+            f.write('static file\n')
+
+        port = free_port()
+        env = dict(os.environ, PYTHONPATH=os.pathsep.join(sys.path))
+        proc = subprocess.Popen([sys.executable, '-c', SERVER_SCRIPT, str(port), directory],
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE, env=env)
+        try:
+            deadline = time.time() + 5
+            while True:
+                try:
+                    socket.create_connection(('127.0.0.1', port), 1).close()
+                    break
+                except socket.error:
+                    if time.time() > deadline:
+                        raise
+                    time.sleep(0.05)
+
+            conn = httplib.HTTPConnection('127.0.0.1', port, timeout=5)
+            for path in ('/header', '/header', '/static/file.txt', '/missing'):
+                conn.request('GET', path)
+                conn.getresponse().read()
+            conn.close()
+        finally:
+            proc.send_signal(signal.SIGINT)
+            out, err = proc.communicate()
+            remove_package(directory)
+
+        # Status lines, the dispatch cache and the server are all gone by the report
+        self.assertEqual(proc.returncode, 0)
+        self.assertFalse('still allocated' in err, err)
+
+
+if __name__ == '__main__':
+    unittest.main()
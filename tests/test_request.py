@@ -6,6 +6,22 @@ import unittest
 
 import guava
 
+from tests.live_server import LiveServer, make_package, remove_package
+
+
+ECHO_CONTROLLER = '''import guava
+
+
+class EchoController(guava.controller.Controller):
+
+    def index(self):
+        files = []
+        for name, f in sorted(self.FILES.items()):
+            body = f['body'] if 'body' in f else open(f['path'], 'rb').read()
+            files.append((name, f['filename'], f['content_type'], f['size'], body))
+        self.write(repr((sorted(self.POST.items()), files)))
+'''
+
 
 class TestRequestInit(unittest.TestCase):
 
@@ -47,6 +63,10 @@ class TestRequestInit(unittest.TestCase):
 
     def test_HEADERS(self):
         self.assertEqual(self.req.HEADERS, {'UserAgent': 'xxx'})
+        self.assertEqual(guava.request.Request().HEADERS, {})
+
+    def test_FILES(self):
+        self.assertEqual(self.req.FILES, {})
 
     def test_GET(self):
         self.assertEqual(self.req.GET, {'a': 10})
@@ -55,5 +75,86 @@ class TestRequestInit(unittest.TestCase):
         self.assertEqual(self.req.POST, {'a': 20})
 
 
+class TestRequestBody(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = make_package('body_controllers', {'echo': ECHO_CONTROLLER})
+        cls.server = LiveServer(routers=(guava.router.MVCRouter('/', package='body_controllers'),),
+                                upload_spill_size=16)
+        cls.server.start()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.stop()
+        remove_package(cls.directory)
+
+    def post(self, content_type, chunks):
+        head = ('POST /echo HTTP/1.1\r\n'
+                'Host: localhost\r\n'
+                'Connection: close\r\n'
+                'Content-Type: %s\r\n'
+                'Content-Length: %d\r\n'
+                '\r\n') % (content_type, sum(len(chunk) for chunk in chunks))
+        return self.server.send_chunks([head] + chunks)
+
+    def test_urlencoded_split_across_chunks(self):
+        # The body arrives with a key and an escape cut in half
+        status, headers, body = self.post('application/x-www-form-urlencoded',
+                                          ['name=hello+world&ci', 'ty=S%C', '3%A3o+Paulo&empty=&key=value'])
+        self.assertEqual(status, 200)
+        self.assertEqual(eval(body)[0], [('city', 'S\xc3\xa3o Paulo'),
+                                      ('empty', ''),
+                                      ('key', 'value'),
+                                      ('name', 'hello world')])
+
+    def test_urlencoded_invalid_escape(self):
+        status, headers, body = self.post('application/x-www-form-urlencoded', ['a=100%25&b=%zz&c=%4'])
+        self.assertEqual(status, 200)
+        self.assertEqual(eval(body)[0], [('a', '100%'), ('b', '%zz'), ('c', '%4')])
+
+    def test_multipart_split_across_chunks(self):
+        body = ('preamble\r\n'
+                '--XyZ\r\n'
+                'Content-Disposition: form-data; name="title"\r\n'
+                '\r\n'
+                'hello\r\n-- world\r\n'
+                '--XyZ\r\n'
+                'Content-Disposition: form-data; name="small"; filename="a.txt"\r\n'
+                'Content-Type: text/plain\r\n'
+                '\r\n'
+                'tiny\r\n'
+                '--XyZ\r\n'
+                'Content-Disposition: form-data; name="big"; filename="b.bin"\r\n'
+                '\r\n'
+                '0123456789\r\n--Xy0123456789\r\n'
+                '--XyZ--\r\n')
+
+        # Every boundary but the first is cut in half, so are the part headers
+        chunks = []
+        start = 0
+        for cut in (body.index('\r\n--XyZ', 20) + 4, body.index('name="small"'), body.index('\r\n--XyZ--') + 5):
+            chunks.append(body[start:cut])
+            start = cut
+        chunks.append(body[start:])
+
+        status, headers, body = self.post('multipart/form-data; boundary="XyZ"', chunks)
+        self.assertEqual(status, 200)
+
+        fields, files = eval(body)
+        self.assertEqual(fields, [('title', 'hello\r\n-- world')])
+        self.assertEqual(files, [('big', 'b.bin', 'application/octet-stream', 26, '0123456789\r\n--Xy0123456789'),
+                                 ('small', 'a.txt', 'text/plain', 4, 'tiny')])
+
+    def test_multipart_malformed(self):
+        body = ('--XyZ\r\n'
+                'Content-Disposition: form-data; name="a"\r\n'
+                '\r\n'
+                '1\r\n'
+                '--XyZjunk\r\n')
+        status, headers, body = self.post('multipart/form-data; boundary=XyZ', [body])
+        self.assertEqual(status, 400)
+
+
 if __name__ == '__main__':
     unittest.main()
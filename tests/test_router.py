@@ -151,6 +151,157 @@ class TestRouter(unittest.TestCase):
         handler = server.route(guava.request.Request(method="GET", url="/static/1.jpg"))
         self.assertTrue(isinstance(handler, guava.handler.StaticHandler))
 
+    def test_static_memory_file_size(self):
+        router = guava.router.StaticRouter("/static", directory="./static", memory_file_size=4096)
+        self.assertEqual(router.memory_file_size, 4096)
+
+        router.memory_file_size = 0
+        self.assertEqual(router.memory_file_size, 0)
+
+        self.assertRaises(ValueError, guava.router.StaticRouter, "/static", directory="./static", memory_file_size=-1)
+
+    def test_static_cache_control(self):
+        router = guava.router.StaticRouter("/static", directory="./static")
+        self.assertEqual(router.cache_control, None)
+
+        router = guava.router.StaticRouter("/static", directory="./static", cache_control="public, max-age=3600")
+        self.assertEqual(router.cache_control, "public, max-age=3600")
+
+        router.cache_control = None
+        self.assertEqual(router.cache_control, None)
+
+        self.assertRaises(TypeError, setattr, router, "cache_control", 3600)
+
+    def test_static_gzip(self):
+        router = guava.router.StaticRouter("/static", directory="./static")
+        self.assertFalse(router.gzip_static)
+        self.assertFalse(router.gzip)
+
+        router = guava.router.StaticRouter("/static", directory="./static", gzip_static=True, gzip=True)
+        self.assertTrue(router.gzip_static)
+        self.assertTrue(router.gzip)
+
+        router.gzip = False
+        self.assertFalse(router.gzip)
+
+        self.assertRaises(TypeError, setattr, router, "gzip_static", 1)
+
+    def test_many_mount_points(self):
+        server = guava.server.Server()
+
+        server.add_router(guava.router.MVCRouter("/", package='controllers'))
+        for i in range(1000):
+            server.add_router(guava.router.MVCRouter("/m%d/" % i, package='controllers.m%d' % i))
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/m500/abc?q=/m1/")),
+                            'controllers.m500',
+                            'abc',
+                            'AbcController',
+                            'index')
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/m5000/abc")),
+                            'controllers',
+                            'm5000',
+                            'M5000Controller',
+                            'abc')
+
+        server.add_router(guava.router.MVCRouter("/m5000/", package='controllers.m5000'))
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/m5000/abc")),
+                            'controllers.m5000',
+                            'abc',
+                            'AbcController',
+                            'index')
+
+
+    def test_mount_point_change(self):
+        server = guava.server.Server()
+        blog = guava.router.MVCRouter("/blog/", package='controllers.blog')
+        server.add_router(guava.router.MVCRouter("/", package='controllers'), blog)
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/blog/abc")),
+                            'controllers.blog',
+                            'abc',
+                            'AbcController',
+                            'index')
+
+        # Moving a router after it was added takes effect on the next request
+        blog.mount_point = "/news/"
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/news/abc")),
+                            'controllers.blog',
+                            'abc',
+                            'AbcController',
+                            'index')
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/blog/abc")),
+                            'controllers',
+                            'blog',
+                            'BlogController',
+                            'abc')
+
+    def test_route_cache(self):
+        server = guava.server.Server()
+        server.add_router(guava.router.MVCRouter("/", package='controllers'))
+
+        for i in range(3):
+            self.assert_handler(server.route(guava.request.Request(method="GET", url="/post/view/%d" % i)),
+                                'controllers',
+                                'post',
+                                'PostController',
+                                'view',
+                                (str(i),))
+
+        stats = server.stats()['route_cache']
+        self.assertEqual(stats['size'], 1)
+        self.assertEqual(stats['hits'], 2)
+        self.assertEqual(stats['misses'], 1)
+
+    def test_custom_routers(self):
+        class AboutRouter(guava.router.Router):
+            def route(self, req):
+                if req.path == '/about':
+                    return guava.handler.Handler(module='about', cls='AboutController', action='index')
+                return None
+
+        server = guava.server.Server()
+        server.add_router(guava.router.MVCRouter("/", package='controllers'))
+        server.add_router(guava.router.Router({
+            '/me': guava.handler.Handler(package='controllers', module='me', cls='MeController', action='index')
+        }))
+        server.add_router(AboutRouter())
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/me")),
+                            'controllers',
+                            'me',
+                            'MeController',
+                            'index')
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/about")),
+                            '.',
+                            'about',
+                            'AboutController',
+                            'index')
+
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/post/view")),
+                            'controllers',
+                            'post',
+                            'PostController',
+                            'view')
+
+    def test_custom_router_returns_no_handler(self):
+        class BrokenRouter(guava.router.Router):
+            def route(self, req):
+                return 'about'
+
+        server = guava.server.Server()
+        server.add_router(guava.router.MVCRouter("/", package='controllers'))
+        server.add_router(BrokenRouter())
+
+        # Anything but a handler is no match, the mounted router answers instead
+        self.assert_handler(server.route(guava.request.Request(method="GET", url="/about")),
+                            'controllers',
+                            'about',
+                            'AboutController',
+                            'index')
 
     def assert_handler(self, handler, package, module, cls, action, args=()):
         self.assertEqual(handler.package, package)
@@ -52,6 +52,49 @@ class TestCustomRouter(unittest.TestCase):
         self.assertEqual(handler.cls, 'AboutController')
         self.assertEqual(handler.action, 'index')
 
+    def test_path_templates(self):
+        router = guava.router.Router({
+            '/me': guava.handler.Handler(module='me', cls='MeController', action='index'),
+            '/users/{id:int}': guava.handler.Handler(module='users', cls='UsersController', action='view'),
+            '/users/{id:int}/posts/{slug}': guava.handler.Handler(module='posts', cls='PostsController', action='view'),
+        })
+
+        handler = router.route(guava.request.Request(url='/me?from=home', method='GET'))
+        self.assertEqual(handler.module, 'me')
+
+        handler = router.route(guava.request.Request(url='/users/10', method='GET'))
+        self.assertEqual(handler.action, 'view')
+        self.assertEqual(handler.args, (10,))
+
+        handler = router.route(guava.request.Request(url='/users/10/posts/hello', method='GET'))
+        self.assertEqual(handler.module, 'posts')
+        self.assertEqual(handler.args, (10, 'hello'))
+
+        self.assertEqual(router.route(guava.request.Request(url='/users/bob', method='GET')), None)
+
+    def test_path_template_replaced(self):
+        router = guava.router.Router({
+            '/users/{id:int}': guava.handler.Handler(module='users', cls='UsersController', action='view'),
+        })
+
+        handler = router.route(guava.request.Request(url='/users/10', method='GET'))
+        self.assertEqual(handler.module, 'users')
+
+        # Same key, same size, only the handler differs
+        routes = router.routes()
+        routes['/users/{id:int}'] = guava.handler.Handler(module='members', cls='MembersController', action='view')
+        handler = router.route(guava.request.Request(url='/users/10', method='GET'))
+        self.assertEqual(handler.module, 'members')
+        self.assertEqual(handler.args, (10,))
+
+        # One template taking the place of another
+        del routes['/users/{id:int}']
+        routes['/people/{name}'] = guava.handler.Handler(module='people', cls='PeopleController', action='view')
+        self.assertEqual(router.route(guava.request.Request(url='/users/10', method='GET')), None)
+        handler = router.route(guava.request.Request(url='/people/bob', method='GET'))
+        self.assertEqual(handler.module, 'people')
+        self.assertEqual(handler.args, ('bob',))
+
 
 if __name__ == '__main__':
     unittest.main()
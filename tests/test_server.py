@@ -0,0 +1,114 @@
+# Copyright 2014 The guava Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+import errno
+import socket
+import time
+import unittest
+import guava
+
+from tests.live_server import LiveServer
+
+
+class TestServer(unittest.TestCase):
+
+    def test_default_workers(self):
+        server = guava.server.Server()
+        self.assertEqual(server.workers, 1)
+
+    def test_workers(self):
+        server = guava.server.Server(ip='127.0.0.1', port=8000, workers=4)
+        self.assertEqual(server.workers, 4)
+
+    def test_invalid_workers(self):
+        self.assertRaises(ValueError, guava.server.Server, workers=0)
+
+    def test_stats(self):
+        stats = guava.server.Server().stats()
+        self.assertEqual(stats['read_buffers']['hits'], 0)
+        self.assertEqual(stats['read_buffers']['misses'], 0)
+        self.assertEqual(stats['idle_read_buffers']['hits'], 0)
+        self.assertEqual(stats['idle_read_buffers']['misses'], 0)
+        self.assertEqual(stats['header_buffers']['cached'], 0)
+        self.assertEqual(stats['conns']['cached'], 0)
+        self.assertEqual(stats['responses']['cached'], 0)
+        self.assertEqual(stats['file_cache']['size'], 0)
+        self.assertEqual(stats['file_cache']['memory_bytes'], 0)
+
+    def test_clear_dispatch_cache(self):
+        server = guava.server.Server()
+        server.clear_dispatch_cache()
+        self.assertEqual(server.stats()['dispatch']['size'], 0)
+
+    def test_invalid_timeouts(self):
+        self.assertRaises(ValueError, guava.server.Server, header_timeout=-1)
+        self.assertRaises(ValueError, guava.server.Server, keepalive_timeout=-1)
+
+    def test_invalid_max_body_size(self):
+        self.assertRaises(ValueError, guava.server.Server, max_body_size=-1)
+
+    def test_invalid_static_memory_budget(self):
+        self.assertRaises(ValueError, guava.server.Server, static_memory_budget=-1)
+
+    def test_invalid_high_water(self):
+        self.assertRaises(ValueError, guava.server.Server, conn_high_water=-1)
+        self.assertRaises(ValueError, guava.server.Server, response_high_water=-1)
+
+    def test_serve_address_in_use(self):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        sock.bind(('127.0.0.1', 0))
+        sock.listen(1)
+        port = sock.getsockname()[1]
+
+        try:
+            # Fails before any worker is forked
+            for workers in (1, 2):
+                server = guava.server.Server(ip='127.0.0.1', port=port, workers=workers)
+                with self.assertRaises(IOError) as cm:
+                    server.serve()
+                self.assertEqual(cm.exception.errno, errno.EADDRINUSE)
+        finally:
+            sock.close()
+
+    def test_header_timeout(self):
+        server = LiveServer(header_timeout=1)
+        server.start()
+        try:
+            sock = server.connect()
+            start = time.time()
+            try:
+                self.assertEqual(sock.recv(1), '')
+            except socket.error:
+                pass
+            elapsed = time.time() - start
+            sock.close()
+
+            # The response to the first request is written while the second one is
+            # incomplete, its header timeout still applies after that write
+            sock = server.connect()
+            start = time.time()
+            sock.sendall('GET /missing HTTP/1.1\r\nHost: localhost\r\n\r\nGET /missing HTTP/1.1\r\nHo')
+            data = ''
+            try:
+                while True:
+                    buf = sock.recv(65536)
+                    if not buf:
+                        break
+                    data += buf
+            except socket.error:
+                pass
+            pipelined = time.time() - start
+            sock.close()
+        finally:
+            server.stop()
+
+        # The timer wheel never fires early and at most one tick late
+        self.assertTrue(1 <= elapsed < 3, elapsed)
+
+        self.assertEqual(data.count('HTTP/1.1 404'), 1)
+        self.assertTrue(1 <= pipelined < 3, pipelined)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,203 @@
+# Copyright 2014 The guava Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style
+# license that can be found in the LICENSE file.
+
+import gzip
+import os
+import shutil
+import tempfile
+import unittest
+import zlib
+import guava
+
+from StringIO import StringIO
+
+from tests.live_server import LiveServer
+
+
+CONTENT = ''.join('line %04d of the static file\n' % i for i in range(200))
+
+SCRIPT = 'var answer = 42;\n' * 100
+
+PRECOMPRESSED = 'served from the .gz sibling\n'
+
+
+def gzipped(data):
+    buf = StringIO()
+    f = gzip.GzipFile(fileobj=buf, mode='wb')
+    f.write(data)
+    f.close()
+    return buf.getvalue()
+
+
+class TestStatic(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        cls.directory = tempfile.mkdtemp()
+        files = {
+            'mem/file.txt': CONTENT,
+            'disk/file.txt': CONTENT,
+            'gz/file.txt': CONTENT,
+            'gz/app.js': SCRIPT,
+            'gz/app.js.gz': gzipped(PRECOMPRESSED),
+            'gz/locked.js': SCRIPT,
+            'gz/locked.js.gz': gzipped(PRECOMPRESSED),
+        }
+        for name, data in files.items():
+            path = os.path.join(cls.directory, name)
+            if not os.path.isdir(os.path.dirname(path)):
+                os.makedirs(os.path.dirname(path))
+            with open(path, 'wb') as f:
+                f.write(data)
+
+        # The sibling is there, but the server can't open it
+        os.chmod(os.path.join(cls.directory, 'gz/locked.js.gz'), 0)
+
+        # Small files are served from memory, /disk sends them with sendfile
+        routers = (
+            guava.router.StaticRouter('/mem', directory=os.path.join(cls.directory, 'mem'),
+                                      cache_control='public, max-age=60'),
+            guava.router.StaticRouter('/disk', directory=os.path.join(cls.directory, 'disk'),
+                                      memory_file_size=0),
+            guava.router.StaticRouter('/gz', directory=os.path.join(cls.directory, 'gz'),
+                                      gzip=True, gzip_static=True),
+        )
+        cls.server = LiveServer(routers=routers)
+        cls.server.start()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.stop()
+        shutil.rmtree(cls.directory)
+
+    def get(self, path, **headers):
+        return self.server.request(path, headers)
+
+    def test_whole_file(self):
+        for path in ('/mem/file.txt', '/disk/file.txt'):
+            resp, body = self.get(path)
+            self.assertEqual(resp.status, 200)
+            self.assertEqual(body, CONTENT)
+            self.assertEqual(resp.getheader('accept-ranges'), 'bytes')
+            self.assertTrue(resp.getheader('etag'))
+            self.assertTrue(resp.getheader('last-modified'))
+
+    def test_single_range(self):
+        for path in ('/mem/file.txt', '/disk/file.txt'):
+            resp, body = self.get(path, Range='bytes=10-19')
+            self.assertEqual(resp.status, 206)
+            self.assertEqual(resp.getheader('content-range'), 'bytes 10-19/%d' % len(CONTENT))
+            self.assertEqual(body, CONTENT[10:20])
+
+            resp, body = self.get(path, Range='bytes=-5')
+            self.assertEqual(resp.status, 206)
+            self.assertEqual(body, CONTENT[-5:])
+
+    def test_unsatisfiable_range(self):
+        for path in ('/mem/file.txt', '/disk/file.txt'):
+            resp, body = self.get(path, Range='bytes=%d-' % len(CONTENT))
+            self.assertEqual(resp.status, 416)
+            self.assertEqual(resp.getheader('content-range'), 'bytes */%d' % len(CONTENT))
+
+    def test_multiple_ranges(self):
+        for path in ('/mem/file.txt', '/disk/file.txt'):
+            resp, body = self.get(path, Range='bytes=0-4,100-109')
+            self.assertEqual(resp.status, 206)
+
+            content_type = resp.getheader('content-type')
+            self.assertTrue(content_type.startswith('multipart/byteranges; boundary='))
+            boundary = content_type.split('boundary=')[1]
+
+            for first, last in ((0, 4), (100, 109)):
+                part = ('Content-Range: bytes %d-%d/%d\r\n\r\n%s\r\n--%s'
+                        % (first, last, len(CONTENT), CONTENT[first:last + 1], boundary))
+                self.assertTrue(part in body, part)
+            self.assertTrue(body.rstrip().endswith('--%s--' % boundary))
+
+    def test_malformed_range_is_ignored(self):
+        resp, body = self.get('/mem/file.txt', Range='lines=1-2')
+        self.assertEqual(resp.status, 200)
+        self.assertEqual(body, CONTENT)
+
+    def test_if_none_match(self):
+        for path in ('/mem/file.txt', '/disk/file.txt'):
+            resp, body = self.get(path)
+            etag = resp.getheader('etag')
+
+            resp, body = self.get(path, **{'If-None-Match': etag})
+            self.assertEqual(resp.status, 304)
+            self.assertEqual(body, '')
+            self.assertEqual(resp.getheader('etag'), etag)
+
+            resp, body = self.get(path, **{'If-None-Match': '"other", W/%s' % etag})
+            self.assertEqual(resp.status, 304)
+
+            resp, body = self.get(path, **{'If-None-Match': '"other"'})
+            self.assertEqual(resp.status, 200)
+            self.assertEqual(body, CONTENT)
+
+    def test_if_modified_since(self):
+        resp, body = self.get('/mem/file.txt')
+        last_modified = resp.getheader('last-modified')
+
+        resp, body = self.get('/mem/file.txt', **{'If-Modified-Since': last_modified})
+        self.assertEqual(resp.status, 304)
+        self.assertEqual(body, '')
+
+        resp, body = self.get('/mem/file.txt', **{'If-Modified-Since': 'Thu, 01 Jan 1970 00:00:00 GMT'})
+        self.assertEqual(resp.status, 200)
+
+    def test_cache_control(self):
+        resp, body = self.get('/mem/file.txt')
+        self.assertEqual(resp.getheader('cache-control'), 'public, max-age=60')
+
+        resp, body = self.get('/disk/file.txt')
+        self.assertEqual(resp.getheader('cache-control'), None)
+
+    def test_gzip(self):
+        resp, body = self.get('/gz/file.txt', **{'Accept-Encoding': 'gzip, deflate'})
+        self.assertEqual(resp.status, 200)
+        self.assertEqual(resp.getheader('content-encoding'), 'gzip')
+        self.assertEqual(resp.getheader('vary'), 'Accept-Encoding')
+        self.assertTrue(len(body) < len(CONTENT))
+        self.assertEqual(zlib.decompress(body, 16 + zlib.MAX_WBITS), CONTENT)
+
+        # The compressed contents are cached, the second answer is the same
+        resp, again = self.get('/gz/file.txt', **{'Accept-Encoding': 'gzip'})
+        self.assertEqual(again, body)
+
+        resp, body = self.get('/gz/file.txt')
+        self.assertEqual(resp.getheader('content-encoding'), None)
+        self.assertEqual(resp.getheader('vary'), 'Accept-Encoding')
+        self.assertEqual(body, CONTENT)
+
+        resp, body = self.get('/gz/file.txt', **{'Accept-Encoding': 'gzip;q=0'})
+        self.assertEqual(resp.getheader('content-encoding'), None)
+        self.assertEqual(body, CONTENT)
+
+    def test_gzip_static(self):
+        resp, body = self.get('/gz/app.js', **{'Accept-Encoding': 'gzip'})
+        self.assertEqual(resp.status, 200)
+        self.assertEqual(resp.getheader('content-encoding'), 'gzip')
+        self.assertEqual(zlib.decompress(body, 16 + zlib.MAX_WBITS), PRECOMPRESSED)
+
+        resp, body = self.get('/gz/app.js')
+        self.assertEqual(resp.getheader('content-encoding'), None)
+        self.assertEqual(body, SCRIPT)
+
+    def test_gzip_static_unreadable_sibling(self):
+        if os.access(os.path.join(self.directory, 'gz/locked.js.gz'), os.R_OK):
+            self.skipTest('file permissions are not enforced for this user')
+
+        resp, body = self.get('/gz/locked.js', **{'Accept-Encoding': 'gzip'})
+        self.assertEqual(resp.status, 200)
+
+        # Compressed on the fly from the file itself instead
+        if resp.getheader('content-encoding') == 'gzip':
+            body = zlib.decompress(body, 16 + zlib.MAX_WBITS)
+        self.assertEqual(body, SCRIPT)
+
+
+if __name__ == '__main__':
+    unittest.main()